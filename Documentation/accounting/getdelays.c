@@ -8,7 +8,7 @@
  * Copyright (c) Jay Lan, SGI. 2006
  *
  * Compile with
- *	gcc -I/usr/src/linux/include getdelays.c -o getdelays
+ *	gcc -I/usr/src/linux/include getdelays.c -o getdelays -lrt
  */
 
 #include <stdio.h>
@@ -18,6 +18,10 @@
 #include <poll.h>
 #include <string.h>
 #include <fcntl.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dirent.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -51,6 +55,8 @@ int dbg;
 int print_delays;
 int print_io_accounting;
 int print_task_context_switch_counts;
+int dump_all;
+int scan_proc;
 __u64 stime, utime;
 
 #define PRINTF(fmt, arg...) {			\
@@ -63,6 +69,10 @@ __u64 stime, utime;
 #define MAX_MSG_SIZE	1024
 /* Maximum number of cpus expected to be specified in a cpumask */
 #define MAX_CPUS	32
+/* Receive buffer for multipart dump replies */
+#define DUMP_BUF_SIZE	32768
+/* Passes averaged over by -a and -P */
+#define SCAN_PASSES	10
 
 struct msgtemplate {
 	struct nlmsghdr n;
@@ -74,10 +84,13 @@ char cpumask[100+6*MAX_CPUS];
 
 static void usage(void)
 {
-	fprintf(stderr, "getdelays [-dilv] [-w logfile] [-r bufsize] "
+	fprintf(stderr, "getdelays [-adilPv] [-w logfile] [-r bufsize] "
 			"[-m cpumask] [-t tgid] [-p pid]\n");
+	fprintf(stderr, "  -a: dump all tasks in one request and time it\n");
 	fprintf(stderr, "  -d: print delayacct stats\n");
-	fprintf(stderr, "  -i: print IO accounting (works only with -p)\n");
+	fprintf(stderr, "  -i: print IO accounting (works only with -p or -a)\n");
+	fprintf(stderr, "  -P: time reading stat, status and statm of every "
+			"task in /proc\n");
 	fprintf(stderr, "  -l: listen forever\n");
 	fprintf(stderr, "  -v: debug on\n");
 	fprintf(stderr, "  -C: container path\n");
@@ -245,6 +258,157 @@ static void print_ioacct(struct taskstats *t)
 		(unsigned long long)t->cancelled_write_bytes);
 }
 
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Send a TASKSTATS_CMD_GET with NLM_F_DUMP and walk the multipart reply.
+ * Returns the number of tasks reported, or -1 on error.
+ */
+static int dump_tasks(int sd, __u16 id, __u32 mypid, int print)
+{
+	static char buf[DUMP_BUF_SIZE];
+	struct msgtemplate msg;
+	struct sockaddr_nl nladdr;
+	struct nlmsghdr *nlh;
+	struct nlattr *na;
+	int ntasks = 0;
+	int rep_len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	msg.n.nlmsg_type = id;
+	msg.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	msg.n.nlmsg_pid = mypid;
+	msg.g.cmd = TASKSTATS_CMD_GET;
+	msg.g.version = 0x1;
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(sd, &msg, msg.n.nlmsg_len, 0, (struct sockaddr *) &nladdr,
+		   sizeof(nladdr)) < 0)
+		return -1;
+
+	for (;;) {
+		rep_len = recv(sd, buf, sizeof(buf), 0);
+		if (rep_len < 0)
+			return -1;
+		for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, rep_len);
+		     nlh = NLMSG_NEXT(nlh, rep_len)) {
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return ntasks;
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(nlh);
+				fprintf(stderr, "dump error, errno %d\n",
+					err->error);
+				return -1;
+			}
+			ntasks++;
+			if (!print)
+				continue;
+			/* TASKSTATS_TYPE_AGGR_PID { PID, STATS } */
+			na = (struct nlattr *) GENLMSG_DATA(nlh);
+			if (na->nla_type != TASKSTATS_TYPE_AGGR_PID)
+				continue;
+			na = (struct nlattr *) NLA_DATA(na);
+			printf("PID\t%d\n", *(int *) NLA_DATA(na));
+			na = (struct nlattr *) ((char *) na +
+						NLA_ALIGN(na->nla_len));
+			if (print_delays)
+				print_delayacct((struct taskstats *) NLA_DATA(na));
+			if (print_io_accounting)
+				print_ioacct((struct taskstats *) NLA_DATA(na));
+			if (print_task_context_switch_counts)
+				task_context_switch_counts((struct taskstats *) NLA_DATA(na));
+		}
+	}
+}
+
+/* Read one /proc file the way a process monitor would. */
+static int slurp(const char *path)
+{
+	char buf[4096];
+	int fd, n;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, sizeof(buf));
+	close(fd);
+	return n;
+}
+
+/*
+ * Read /proc/<pid>/stat, status and statm for every task, which is what
+ * top and ps do to get the values a single dump returns.  Returns the
+ * number of tasks read.
+ */
+static int scan_proc_tasks(void)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *dir;
+	int ntasks = 0;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return -1;
+	while ((de = readdir(dir))) {
+		if (!isdigit(de->d_name[0]))
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		if (slurp(path) < 0)
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/status", de->d_name);
+		slurp(path);
+		snprintf(path, sizeof(path), "/proc/%s/statm", de->d_name);
+		slurp(path);
+		ntasks++;
+	}
+	closedir(dir);
+	return ntasks;
+}
+
+/*
+ * Time SCAN_PASSES full passes over all tasks through the dump request
+ * and/or through /proc, and print the average cost of one pass.
+ */
+static void time_scans(int sd, __u16 id, __u32 mypid)
+{
+	unsigned long long start, dump_us = 0, proc_us = 0;
+	int i, n = 0;
+
+	if (dump_all) {
+		/* warm up, and print the records once if asked to */
+		if (dump_tasks(sd, id, mypid, print_delays ||
+			       print_io_accounting ||
+			       print_task_context_switch_counts) < 0)
+			err(1, "dump failed\n");
+		start = now_us();
+		for (i = 0; i < SCAN_PASSES; i++)
+			n = dump_tasks(sd, id, mypid, 0);
+		dump_us = (now_us() - start) / SCAN_PASSES;
+		printf("taskstats dump: %d tasks in %llu us per pass\n",
+		       n, dump_us);
+	}
+	if (scan_proc) {
+		scan_proc_tasks();
+		start = now_us();
+		for (i = 0; i < SCAN_PASSES; i++)
+			n = scan_proc_tasks();
+		proc_us = (now_us() - start) / SCAN_PASSES;
+		printf("/proc stat+status+statm: %d tasks in %llu us per pass\n",
+		       n, proc_us);
+	}
+	if (dump_us && proc_us)
+		printf("/proc costs %.1fx the dump\n",
+		       (double) proc_us / dump_us);
+}
+
 int main(int argc, char *argv[])
 {
 	int c, rc, rep_len, aggr_len, len2;
@@ -273,11 +437,17 @@ int main(int argc, char *argv[])
 	struct msgtemplate msg;
 
 	while (!forking) {
-		c = getopt(argc, argv, "qdiw:r:m:t:p:vlC:c:");
+		c = getopt(argc, argv, "aqdiPw:r:m:t:p:vlC:c:");
 		if (c < 0)
 			break;
 
 		switch (c) {
+		case 'a':
+			dump_all = 1;
+			break;
+		case 'P':
+			scan_proc = 1;
+			break;
 		case 'd':
 			printf("print delayacct stats ON\n");
 			print_delays = 1;
@@ -427,6 +597,10 @@ int main(int argc, char *argv[])
 			goto err;
 		}
 	}
+	if (dump_all || scan_proc) {
+		time_scans(nl_sd, id, mypid);
+		goto done;
+	}
 	if (!maskset && !tid && !containerset) {
 		usage();
 		goto err;
@@ -0,0 +1,145 @@
+/*
+ * randread.c - many-thread small random read benchmark
+ *
+ * Each thread opens the device itself (so it gets its own io_context)
+ * and issues synchronous 4k O_DIRECT reads at random aligned offsets,
+ * one at a time, for a fixed time.  With a fast device the cost per
+ * request in the block layer and the I/O scheduler dominates.
+ *
+ * The device should be request based, so that requests go through the
+ * elevator; brd and loop are not.  scsi_debug with no delay works well:
+ *
+ *	modprobe scsi_debug dev_size_mb=256 delay=0
+ *	echo cfq > /sys/block/sdX/queue/scheduler
+ *	./randread -t 32 -s 10 /dev/sdX
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+#define BS	4096
+
+static const char *dev;
+static unsigned long long nr_blocks;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long long ios;
+	int err;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	void *buf;
+	int fd;
+
+	fd = open(dev, O_RDONLY | O_DIRECT);
+	if (fd < 0 || posix_memalign(&buf, BS, BS)) {
+		w->err = errno;
+		return NULL;
+	}
+	while (!stop) {
+		unsigned long long blk;
+
+		blk = (((unsigned long long)rand_r(&w->seed) << 31) |
+		       rand_r(&w->seed)) % nr_blocks;
+		if (pread(fd, buf, BS, blk * BS) != BS) {
+			w->err = errno ? errno : EIO;
+			break;
+		}
+		w->ios++;
+	}
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-s seconds] <blockdev>\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 16, seconds = 10;
+	unsigned long long total = 0, size;
+	struct timeval start, end;
+	struct worker *workers;
+	double elapsed;
+	int i, fd, c;
+
+	while ((c = getopt(argc, argv, "t:s:")) != -1) {
+		switch (c) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_threads <= 0 || seconds <= 0)
+		usage(argv[0]);
+	dev = argv[optind];
+
+	fd = open(dev, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &size)) {
+		perror(dev);
+		return 1;
+	}
+	close(fd);
+	nr_blocks = size / BS;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s: device too small\n", dev);
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		return 1;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].seed = i + 1;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].err) {
+			fprintf(stderr, "thread %d: %s\n", i,
+				strerror(workers[i].err));
+			return 1;
+		}
+		total += workers[i].ios;
+	}
+	gettimeofday(&end, NULL);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1e6;
+	printf("%d threads, %.2f s: %llu reads, %.0f IOPS\n",
+	       nr_threads, elapsed, total, total / elapsed);
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * gcstall.c - overwrite latency on a nearly full flash filesystem
+ *
+ * Fills <dir> with files of -s KB until -f percent of the filesystem is
+ * used, then for -t seconds rewrites randomly chosen files and fsyncs
+ * them, timing each rewrite.  Once the free blocks are used up every
+ * rewrite depends on garbage collection, and a rewrite that has to
+ * collect inline shows up in the tail of the latency distribution.  The
+ * lines of <proc file> that mention gc are printed at the end, e.g. for
+ * yaffs2 on nandsim:
+ *
+ *	mount -t yaffs2 /dev/mtdblock0 /mnt/flash
+ *	./gcstall -f 80 -t 60 /mnt/flash /proc/yaffs
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_SAMPLES	100000
+
+static double samples[MAX_SAMPLES];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int write_file(const char *dir, int nr, const char *buf, long size)
+{
+	char path[4096];
+	int fd, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/gc%06d", dir, nr);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	if (write(fd, buf, size) != size || fsync(fd))
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+static double used(const char *dir)
+{
+	struct statvfs st;
+
+	if (statvfs(dir, &st) || !st.f_blocks)
+		return 1;
+	return 1 - (double)st.f_bfree / st.f_blocks;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_gc_lines(const char *path)
+{
+	char line[256];
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return;
+	}
+	while (fgets(line, sizeof(line), f))
+		if (strstr(line, "gc") || strstr(line, "amplification"))
+			fputs(line, stdout);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-f fill percent] [-t seconds] "
+		"[-s file KB] <dir> [proc file]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int fill = 80, secs = 30, nr_files = 0, n = 0, c;
+	long size = 64 * 1024;
+	double end, t, sum = 0;
+	const char *dir;
+	char *buf;
+
+	while ((c = getopt(argc, argv, "f:t:s:")) != -1) {
+		switch (c) {
+		case 'f':
+			fill = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 's':
+			size = atol(optarg) * 1024;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 && optind != argc - 2)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	buf = malloc(size);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+	memset(buf, 0x3c, size);
+
+	t = now();
+	while (used(dir) * 100 < fill) {
+		if (write_file(dir, nr_files, buf, size)) {
+			perror("fill");
+			return 1;
+		}
+		nr_files++;
+	}
+	printf("filled %d files of %ld KB in %.1f s, %.0f%% used\n",
+	       nr_files, size / 1024, now() - t, used(dir) * 100);
+	if (!nr_files)
+		return 1;
+
+	srandom(1);
+	end = now() + secs;
+	while (n < MAX_SAMPLES && (t = now()) < end) {
+		buf[0] = n;
+		if (write_file(dir, random() % nr_files, buf, size)) {
+			perror("rewrite");
+			return 1;
+		}
+		samples[n] = now() - t;
+		sum += samples[n++];
+	}
+	if (!n)
+		return 1;
+	qsort(samples, n, sizeof(samples[0]), cmp);
+	printf("rewrites: %d, avg %.2f ms, median %.2f ms, 99%% %.2f ms, "
+	       "99.9%% %.2f ms, max %.2f ms\n", n, sum * 1e3 / n,
+	       samples[n / 2] * 1e3, samples[n * 99 / 100] * 1e3,
+	       samples[n * 999 / 1000] * 1e3, samples[n - 1] * 1e3);
+	if (optind == argc - 2)
+		print_gc_lines(argv[optind + 1]);
+	return 0;
+}
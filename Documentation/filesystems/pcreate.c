@@ -0,0 +1,198 @@
+/*
+ * pcreate.c - parallel small file creation benchmark
+ *
+ * Each thread creates, writes and closes files in its own subdirectory
+ * of <dir>, so that the threads share only the filesystem: block and
+ * inode allocation, the journal and writeback.  The files are synced
+ * with syncfs() inside the timed section, so that delayed allocation
+ * cannot push the block allocations out of it.  Files are removed again
+ * afterwards, outside the timed section, unless -k is given.
+ *
+ *	for t in 1 2 4 8 16; do ./pcreate -t $t -n 5000 /mnt/ext4; done
+ *
+ * With -s all threads create their files in one shared directory
+ * instead, which measures how creates in a single directory scale; on
+ * ext4 compare a mount with -o pdirops against one without:
+ *
+ *	for t in 1 2 4 8 16; do ./pcreate -s -t $t -n 5000 /mnt/ext4; done
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static const char *top;
+static int nr_files = 1000;
+static int shared;
+static size_t file_size = 4096;
+static char *data;
+static pthread_barrier_t barrier;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	int err;
+};
+
+static void worker_dir(char *buf, int id)
+{
+	if (shared)
+		snprintf(buf, PATH_MAX, "%s/pcreate.shared", top);
+	else
+		snprintf(buf, PATH_MAX, "%s/pcreate.%d", top, id);
+}
+
+static void file_name(char *buf, size_t len, int id, int i)
+{
+	if (shared)
+		snprintf(buf, len, "t%d.f%d", id, i);
+	else
+		snprintf(buf, len, "f%d", i);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	char dir[PATH_MAX], name[32];
+	int i, dfd = -1, fd;
+
+	worker_dir(dir, w->id);
+	if (mkdir(dir, 0755) && errno != EEXIST)
+		w->err = errno;
+	else if ((dfd = open(dir, O_RDONLY | O_DIRECTORY)) < 0)
+		w->err = errno;
+	pthread_barrier_wait(&barrier);
+	if (w->err)
+		return NULL;
+
+	for (i = 0; i < nr_files; i++) {
+		file_name(name, sizeof(name), w->id, i);
+		fd = openat(dfd, name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			w->err = errno;
+			break;
+		}
+		if (file_size &&
+		    write(fd, data, file_size) != (ssize_t)file_size)
+			w->err = errno ? errno : EIO;
+		close(fd);
+		if (w->err)
+			break;
+	}
+	close(dfd);
+	return NULL;
+}
+
+static void cleanup(int nr_threads)
+{
+	char dir[PATH_MAX], name[32];
+	int t, i, dfd;
+
+	for (t = 0; t < nr_threads; t++) {
+		worker_dir(dir, t);
+		dfd = open(dir, O_RDONLY | O_DIRECTORY);
+		if (dfd < 0)
+			continue;
+		for (i = 0; i < nr_files; i++) {
+			file_name(name, sizeof(name), t, i);
+			unlinkat(dfd, name, 0);
+		}
+		close(dfd);
+		rmdir(dir);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-n files per thread] "
+		"[-b bytes per file] [-k] [-s] <dir>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 4, keep = 0;
+	struct timeval start, end;
+	struct worker *workers;
+	double elapsed;
+	int i, c, fd, err = 0;
+
+	while ((c = getopt(argc, argv, "t:n:b:ks")) != -1) {
+		switch (c) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 'b':
+			file_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		case 's':
+			shared = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || nr_threads <= 0 || nr_files <= 0)
+		usage(argv[0]);
+	top = argv[optind];
+
+	fd = open(top, O_RDONLY | O_DIRECTORY);
+	data = malloc(file_size + 1);
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (fd < 0 || !data || !workers) {
+		perror(top);
+		return 1;
+	}
+	memset(data, 'x', file_size);
+	pthread_barrier_init(&barrier, NULL, nr_threads + 1);
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	pthread_barrier_wait(&barrier);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].err && !err) {
+			fprintf(stderr, "thread %d: %s\n", i,
+				strerror(workers[i].err));
+			err = 1;
+		}
+	}
+	syscall(__NR_syncfs, fd);
+	gettimeofday(&end, NULL);
+
+	if (!err) {
+		elapsed = (end.tv_sec - start.tv_sec) +
+			  (end.tv_usec - start.tv_usec) / 1e6;
+		printf("%d threads x %d files of %zu bytes%s: %.2f s, "
+		       "%.0f files/s\n", nr_threads, nr_files, file_size,
+		       shared ? " in one directory" : "",
+		       elapsed, nr_threads * nr_files / elapsed);
+	}
+	if (!keep)
+		cleanup(nr_threads);
+	close(fd);
+	return err;
+}
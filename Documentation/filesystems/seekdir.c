@@ -0,0 +1,166 @@
+/*
+ * seekdir.c - cost of resuming a directory scan at a saved offset
+ *
+ * Reads <dir> the way a readdir() user that hands out only part of each
+ * getdents64() buffer does (a file server answering a bounded listing
+ * request, or telldir()/seekdir() around a callback): take half of the
+ * entries returned, lseek() back to the d_off of the last one taken and
+ * read again.  Every lseek() then lands behind the file position.  A
+ * plain sequential scan is timed for reference.  If repositioning is
+ * linear in the directory size, the total grows as N^2; run it for a
+ * few sizes to see the curve:
+ *
+ *	for n in 1000 4000 16000 64000; do
+ *		mkdir /tmp/d$n && ./seekdir -c $n /tmp/d$n
+ *	done
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <linux/types.h>
+
+#define BUF_SIZE	4096
+
+struct dirent64 {
+	__u64		d_ino;
+	__s64		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[0];
+};
+
+struct result {
+	unsigned long entries;
+	unsigned long calls;
+};
+
+static char buf[BUF_SIZE];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int scan(int dfd, int partial, struct result *res)
+{
+	long n, pos;
+
+	lseek(dfd, 0, SEEK_SET);
+	while ((n = syscall(__NR_getdents64, dfd, buf, BUF_SIZE)) > 0) {
+		struct dirent64 *d;
+		int nr = 0, take;
+
+		res->calls++;
+		for (pos = 0; pos < n; pos += d->d_reclen, nr++)
+			d = (void *)(buf + pos);
+		take = partial && nr > 1 ? nr / 2 : nr;
+		res->entries += take;
+		if (take == nr)
+			continue;
+		for (pos = 0; take--; pos += d->d_reclen)
+			d = (void *)(buf + pos);
+		if (lseek(dfd, d->d_off, SEEK_SET) < 0)
+			return -errno;
+	}
+	return n < 0 ? -errno : 0;
+}
+
+static int populate(const char *dir, int nr)
+{
+	char name[32];
+	int dfd, fd, i;
+
+	dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0)
+		return -1;
+	for (i = 0; i < nr; i++) {
+		snprintf(name, sizeof(name), "file%d", i);
+		fd = openat(dfd, name, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0)
+			return -1;
+		close(fd);
+	}
+	close(dfd);
+	return 0;
+}
+
+static double run(int dfd, int partial, struct result *res)
+{
+	double t;
+	int err;
+
+	memset(res, 0, sizeof(*res));
+	t = now();
+	err = scan(dfd, partial, res);
+	t = now() - t;
+	if (err) {
+		errno = -err;
+		return -1;
+	}
+	return t;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c files to create] <dir>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int create = 0, dfd, c;
+	struct result a, b;
+	double ta, tb;
+
+	while ((c = getopt(argc, argv, "c:")) != -1) {
+		switch (c) {
+		case 'c':
+			create = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	if (create && populate(argv[optind], create)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	dfd = open(argv[optind], O_RDONLY | O_DIRECTORY);
+	if (dfd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	ta = run(dfd, 0, &a);
+	if (ta < 0) {
+		perror("sequential scan");
+		return 1;
+	}
+	printf("sequential: %lu entries, %lu calls, %.3f ms, %.3f us/entry\n",
+	       a.entries, a.calls, ta * 1e3,
+	       ta * 1e6 / (a.entries ? a.entries : 1));
+
+	tb = run(dfd, 1, &b);
+	if (tb < 0) {
+		perror("resumed scan");
+		return 1;
+	}
+	printf("resumed:    %lu entries, %lu calls, %.3f ms, %.3f us/entry\n",
+	       b.entries, b.calls, tb * 1e3,
+	       tb * 1e6 / (b.entries ? b.entries : 1));
+	return 0;
+}
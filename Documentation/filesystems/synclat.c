@@ -0,0 +1,184 @@
+/*
+ * synclat.c - syncfs() latency while another filesystem is being flushed
+ *
+ * A dirtier thread keeps rewriting <big file> so its pages stay dirty,
+ * and, with -S, another thread calls sync() in a loop, which queues a
+ * large WB_SYNC_NONE flush on every bdi.  Meanwhile the main thread
+ * writes 4k to a file in <dir> and times syncfs() on it.  Put <big file>
+ * and <dir> on two partitions of the same disk, so that both
+ * filesystems are written back by the same flusher thread:
+ *
+ *	mount /dev/mmcblk0p1 /mnt/a; mount /dev/mmcblk0p2 /mnt/b
+ *	./synclat -S -b /sys/kernel/debug/bdi/179:0/stats /mnt/a/big /mnt/b
+ *
+ * -b prints the per-class writeback counters of that bdi at the end.
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define CHUNK		(1024 * 1024)
+#define MAX_SAMPLES	100000
+
+static char chunk[CHUNK];
+static char block[4096];
+static volatile int stop;
+static double samples[MAX_SAMPLES];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+struct dirtier {
+	const char *path;
+	long size;
+};
+
+static void *dirty_thread(void *arg)
+{
+	struct dirtier *d = arg;
+	long pos = 0;
+	int fd;
+
+	fd = open(d->path, O_WRONLY | O_CREAT, 0644);
+	if (fd < 0) {
+		perror(d->path);
+		exit(1);
+	}
+	while (!stop) {
+		if (pwrite(fd, chunk, CHUNK, pos) != CHUNK) {
+			perror("pwrite");
+			exit(1);
+		}
+		pos += CHUNK;
+		if (pos >= d->size)
+			pos = 0;
+	}
+	close(fd);
+	return NULL;
+}
+
+static void *sync_thread(void *arg)
+{
+	while (!stop) {
+		sync();
+		usleep(10000);
+	}
+	return NULL;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_stats(const char *path)
+{
+	char line[256];
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return;
+	}
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, "class_", 6))
+			fputs(line, stdout);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-S] [-t seconds] [-m MB to keep dirty] "
+		"[-b bdi stats file] <big file> <dir>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct dirtier d = { .size = 128L * CHUNK };
+	pthread_t dirtier, syncer;
+	int with_sync = 0, secs = 30, fd, c, n = 0;
+	const char *stats = NULL;
+	char path[4096];
+	double end, t, sum = 0;
+
+	while ((c = getopt(argc, argv, "St:m:b:")) != -1) {
+		switch (c) {
+		case 'S':
+			with_sync = 1;
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'm':
+			d.size = atol(optarg) * CHUNK;
+			break;
+		case 'b':
+			stats = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 2)
+		usage(argv[0]);
+
+	d.path = argv[optind];
+	snprintf(path, sizeof(path), "%s/synclat.tmp", argv[optind + 1]);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	memset(chunk, 0x5a, sizeof(chunk));
+
+	pthread_create(&dirtier, NULL, dirty_thread, &d);
+	if (with_sync)
+		pthread_create(&syncer, NULL, sync_thread, NULL);
+
+	end = now() + secs;
+	while (n < MAX_SAMPLES && (t = now()) < end) {
+		block[0] = n;
+		if (pwrite(fd, block, sizeof(block), 0) != sizeof(block) ||
+		    syscall(__NR_syncfs, fd)) {
+			perror("syncfs");
+			return 1;
+		}
+		samples[n] = now() - t;
+		sum += samples[n++];
+		usleep(20000);
+	}
+	stop = 1;
+	pthread_join(dirtier, NULL);
+	if (with_sync)
+		pthread_join(syncer, NULL);
+	close(fd);
+	unlink(path);
+
+	if (!n)
+		return 1;
+	qsort(samples, n, sizeof(samples[0]), cmp);
+	printf("syncfs: %d calls, avg %.1f ms, median %.1f ms, "
+	       "99%% %.1f ms, max %.1f ms\n", n, sum * 1e3 / n,
+	       samples[n / 2] * 1e3, samples[n * 99 / 100] * 1e3,
+	       samples[n - 1] * 1e3);
+	if (stats)
+		print_stats(stats);
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * epoll_accept.c - multi-threaded accept/read benchmark for epoll
+ *
+ * A pool of server threads, each with its own epoll instance, watches
+ * one shared listening socket.  A thread woken for it accepts a
+ * connection, reads a small request, writes a reply and closes.  Client
+ * threads in the same process connect over loopback in a tight loop.
+ *
+ * Without EPOLLEXCLUSIVE every incoming connection wakes every server
+ * thread and all but one find nothing to accept.  With -x the listening
+ * socket is added with EPOLLEXCLUSIVE and only one thread is woken.  The
+ * program reports connections per second and wasted wakeups per
+ * connection:
+ *
+ *	./epoll_accept -s 16 -c 16 -t 10
+ *	./epoll_accept -s 16 -c 16 -t 10 -x
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1u << 28)
+#endif
+
+#define MSG_SIZE	64
+
+static int listen_fd;
+static struct sockaddr_in addr;
+static int exclusive;
+static volatile int stop;
+
+struct server {
+	pthread_t thread;
+	unsigned long long wakeups;
+	unsigned long long accepts;
+	unsigned long long empty;	/* woken, but nothing to accept */
+};
+
+struct client {
+	pthread_t thread;
+	unsigned long long conns;
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void *server_fn(void *arg)
+{
+	struct server *s = arg;
+	struct epoll_event ev, events[64];
+	char buf[MSG_SIZE];
+	int epfd, n, i;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		die("epoll_create1");
+	ev.events = EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0);
+	ev.data.fd = listen_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev))
+		die("epoll_ctl(listen)");
+
+	while (!stop) {
+		n = epoll_wait(epfd, events, 64, 100);
+		if (n < 0 && errno != EINTR)
+			die("epoll_wait");
+		for (i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == listen_fd) {
+				s->wakeups++;
+				fd = accept4(listen_fd, NULL, NULL,
+					     SOCK_NONBLOCK);
+				if (fd < 0) {
+					if (errno != EAGAIN)
+						die("accept4");
+					s->empty++;
+					continue;
+				}
+				s->accepts++;
+				ev.events = EPOLLIN;
+				ev.data.fd = fd;
+				if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+					die("epoll_ctl(conn)");
+				continue;
+			}
+			if (read(fd, buf, sizeof(buf)) > 0)
+				write(fd, buf, sizeof(buf));
+			close(fd);
+		}
+	}
+	close(epfd);
+	return NULL;
+}
+
+static void *client_fn(void *arg)
+{
+	struct client *c = arg;
+	char buf[MSG_SIZE];
+
+	memset(buf, 'x', sizeof(buf));
+	while (!stop) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (fd < 0)
+			die("socket");
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+		    write(fd, buf, sizeof(buf)) != sizeof(buf) ||
+		    read(fd, buf, sizeof(buf)) <= 0) {
+			close(fd);
+			continue;
+		}
+		close(fd);
+		c->conns++;
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s servers] [-c clients] [-t seconds] "
+		"[-x]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_servers = 8, nr_clients = 8, seconds = 10;
+	unsigned long long conns = 0, wakeups = 0, empty = 0;
+	struct server *servers;
+	struct client *clients;
+	struct timeval start, end;
+	socklen_t len = sizeof(addr);
+	double elapsed;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "s:c:t:x")) != -1) {
+		switch (c) {
+		case 's':
+			nr_servers = atoi(optarg);
+			break;
+		case 'c':
+			nr_clients = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'x':
+			exclusive = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nr_servers <= 0 || nr_clients <= 0 ||
+	    seconds <= 0)
+		usage(argv[0]);
+
+	listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listen_fd < 0)
+		die("socket");
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(listen_fd, (struct sockaddr *)&addr, &len) ||
+	    listen(listen_fd, 1024))
+		die("listen");
+
+	servers = calloc(nr_servers, sizeof(*servers));
+	clients = calloc(nr_clients, sizeof(*clients));
+	if (!servers || !clients)
+		die("calloc");
+
+	for (i = 0; i < nr_servers; i++)
+		if (pthread_create(&servers[i].thread, NULL, server_fn,
+				   &servers[i]))
+			die("pthread_create");
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_clients; i++)
+		if (pthread_create(&clients[i].thread, NULL, client_fn,
+				   &clients[i]))
+			die("pthread_create");
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr_clients; i++) {
+		pthread_join(clients[i].thread, NULL);
+		conns += clients[i].conns;
+	}
+	gettimeofday(&end, NULL);
+	for (i = 0; i < nr_servers; i++) {
+		pthread_join(servers[i].thread, NULL);
+		wakeups += servers[i].wakeups;
+		empty += servers[i].empty;
+	}
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_usec - start.tv_usec) / 1e6;
+	printf("%s: %d servers, %d clients, %.2f s: %.0f conn/s, "
+	       "%.2f wakeups/conn, %.2f wasted/conn\n",
+	       exclusive ? "exclusive" : "shared", nr_servers, nr_clients,
+	       elapsed, conns / elapsed,
+	       conns ? (double)wakeups / conns : 0.0,
+	       conns ? (double)empty / conns : 0.0);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * treelock.c - mapping->tree_lock statistics for a sequential read and
+ *		a truncate
+ *
+ * Creates <file> (-s MB, default 128), drops the page cache, and reads the
+ * file sequentially, so that readahead inserts every page.  Then it
+ * truncates the fully cached file to zero, which removes every page.
+ * Before each phase /proc/lock_stat is cleared, and after it the
+ * tree_lock entries are printed, so the acquisition count and hold times
+ * of the two phases can be compared between kernels.  Needs root and a
+ * kernel built with CONFIG_LOCK_STAT:
+ *
+ *	./treelock -s 256 /mnt/ext4/bigfile
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define BUF_SIZE	(1024 * 1024)
+
+static char buf[BUF_SIZE];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int write_file(const char *path, const char *text)
+{
+	int fd = open(path, O_WRONLY);
+	int ret = 0;
+
+	if (fd < 0 || write(fd, text, strlen(text)) < 0) {
+		perror(path);
+		ret = -1;
+	}
+	if (fd >= 0)
+		close(fd);
+	return ret;
+}
+
+/*
+ * Print the column header and the class lines (not the contention
+ * points) of every lock whose name mentions tree_lock.
+ */
+static void print_tree_lock(const char *phase)
+{
+	char line[512], name[256];
+	FILE *f = fopen("/proc/lock_stat", "r");
+	int header = 0;
+
+	if (!f) {
+		perror("/proc/lock_stat");
+		return;
+	}
+	printf("%s:\n", phase);
+	while (fgets(line, sizeof(line), f)) {
+		if (!header && strstr(line, "class name")) {
+			fputs(line, stdout);
+			header = 1;
+			continue;
+		}
+		if (sscanf(line, "%255s", name) != 1)
+			continue;
+		if (strstr(name, "tree_lock") && name[strlen(name) - 1] == ':')
+			fputs(line, stdout);
+	}
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s MB] <file>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	long size = 128, i;
+	double t;
+	ssize_t n;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's':
+			size = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	memset(buf, 0xa5, sizeof(buf));
+	for (i = 0; i < size; i++)
+		if (write(fd, buf, BUF_SIZE) != BUF_SIZE) {
+			perror("write");
+			return 1;
+		}
+	fsync(fd);
+	if (write_file("/proc/sys/vm/drop_caches", "3"))
+		return 1;
+
+	write_file("/proc/lock_stat", "0");
+	lseek(fd, 0, SEEK_SET);
+	t = now();
+	while ((n = read(fd, buf, BUF_SIZE)) > 0)
+		;
+	t = now() - t;
+	printf("read %ld MB in %.3f s, %.1f MB/s\n", size, t, size / t);
+	print_tree_lock("sequential read");
+
+	write_file("/proc/lock_stat", "0");
+	t = now();
+	if (ftruncate(fd, 0)) {
+		perror("ftruncate");
+		return 1;
+	}
+	t = now() - t;
+	printf("truncate of %ld MB in %.3f ms\n", size, t * 1e3);
+	print_tree_lock("truncate");
+	close(fd);
+	return 0;
+}
@@ -401,6 +401,18 @@
 #define __NR_clock_adjtime		(__NR_SYSCALL_BASE+372)
 #define __NR_syncfs			(__NR_SYSCALL_BASE+373)
 
+/*
+ * System calls local to this tree live in a block of their own, at the
+ * same offsets from __NR_LOCAL_BASE on every architecture and well above
+ * the numbers allocated upstream, so merging new upstream system calls
+ * never renumbers them.
+ */
+#define __NR_LOCAL_BASE			(__NR_SYSCALL_BASE+1000)
+#define __NR_io_sq_setup		(__NR_LOCAL_BASE+0)
+#define __NR_io_sq_enter		(__NR_LOCAL_BASE+1)
+#define __NR_epoll_ctl_batch		(__NR_LOCAL_BASE+2)
+#define __NR_getdents_stat		(__NR_LOCAL_BASE+3)
+
 /*
  * The following SWIs are ARM private.
  */
@@ -351,9 +351,21 @@
 #define __NR_clock_adjtime	343
 #define __NR_syncfs             344
 
+/*
+ * System calls local to this tree live in a block of their own, at the
+ * same offsets from __NR_LOCAL_BASE on every architecture and well above
+ * the numbers allocated upstream, so merging new upstream system calls
+ * never renumbers them.
+ */
+#define __NR_LOCAL_BASE		1000
+#define __NR_io_sq_setup	(__NR_LOCAL_BASE+0)
+#define __NR_io_sq_enter	(__NR_LOCAL_BASE+1)
+#define __NR_epoll_ctl_batch	(__NR_LOCAL_BASE+2)
+#define __NR_getdents_stat	(__NR_LOCAL_BASE+3)
+
 #ifdef __KERNEL__
 
-#define NR_syscalls 345
+#define NR_syscalls 1004
 
 #define __ARCH_WANT_IPC_PARSE_VERSION
 #define __ARCH_WANT_OLD_READDIR
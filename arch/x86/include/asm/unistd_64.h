@@ -678,6 +678,22 @@ __SYSCALL(__NR_clock_adjtime, sys_clock_adjtime)
 #define __NR_syncfs                             306
 __SYSCALL(__NR_syncfs, sys_syncfs)
 
+/*
+ * System calls local to this tree live in a block of their own, at the
+ * same offsets from __NR_LOCAL_BASE on every architecture and well above
+ * the numbers allocated upstream, so merging new upstream system calls
+ * never renumbers them.
+ */
+#define __NR_LOCAL_BASE				1000
+#define __NR_io_sq_setup			(__NR_LOCAL_BASE+0)
+__SYSCALL(__NR_io_sq_setup, sys_io_sq_setup)
+#define __NR_io_sq_enter			(__NR_LOCAL_BASE+1)
+__SYSCALL(__NR_io_sq_enter, sys_io_sq_enter)
+#define __NR_epoll_ctl_batch			(__NR_LOCAL_BASE+2)
+__SYSCALL(__NR_epoll_ctl_batch, sys_epoll_ctl_batch)
+#define __NR_getdents_stat			(__NR_LOCAL_BASE+3)
+__SYSCALL(__NR_getdents_stat, sys_getdents_stat)
+
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
 #define __ARCH_WANT_OLD_STAT
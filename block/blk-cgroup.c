@@ -182,6 +182,23 @@ static inline void blkio_update_group_iops(struct blkio_group *blkg,
 	}
 }
 
+static inline void blkio_update_group_latency_target(struct blkio_group *blkg,
+			unsigned int latency)
+{
+	struct blkio_policy_type *blkiop;
+
+	list_for_each_entry(blkiop, &blkio_list, list) {
+
+		/* If this policy does not own the blkg, do not send updates */
+		if (blkiop->plid != blkg->plid)
+			continue;
+
+		if (blkiop->ops.blkio_update_group_latency_target_fn)
+			blkiop->ops.blkio_update_group_latency_target_fn(
+						blkg->key, blkg, latency);
+	}
+}
+
 /*
  * Add to the appropriate stat variable depending on the request type.
  * This should be called with the blkg->stats_lock held.
@@ -671,7 +688,7 @@ static int blkio_policy_parse_and_set(char *buf,
 	unsigned long major, minor, temp;
 	int i = 0;
 	dev_t dev;
-	u64 bps, iops;
+	u64 bps, iops, latency;
 
 	memset(s, 0, sizeof(s));
 
@@ -754,6 +771,18 @@ static int blkio_policy_parse_and_set(char *buf,
 			newpn->fileid = fileid;
 			newpn->val.iops = (unsigned int)iops;
 			break;
+		case BLKIO_THROTL_latency_target_device:
+			ret = strict_strtoull(s[1], 10, &latency);
+			if (ret)
+				return -EINVAL;
+
+			if (latency > THROTL_LATENCY_MAX)
+				return -EINVAL;
+
+			newpn->plid = plid;
+			newpn->fileid = fileid;
+			newpn->val.latency = (unsigned int)latency;
+			break;
 		}
 		break;
 	default:
@@ -823,6 +852,17 @@ unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg, dev_t dev)
 		return -1;
 }
 
+unsigned int blkcg_get_latency_target(struct blkio_cgroup *blkcg, dev_t dev)
+{
+	struct blkio_policy_node *pn;
+	pn = blkio_policy_search_node(blkcg, dev, BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_target_device);
+	if (pn)
+		return pn->val.latency;
+	else
+		return 0;
+}
+
 /* Checks whether user asked for deleting a policy rule */
 static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 {
@@ -842,6 +882,10 @@ static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 		case BLKIO_THROTL_write_iops_device:
 			if (pn->val.iops == 0)
 				return 1;
+			break;
+		case BLKIO_THROTL_latency_target_device:
+			if (pn->val.latency == 0)
+				return 1;
 		}
 		break;
 	default:
@@ -867,6 +911,9 @@ static void blkio_update_policy_rule(struct blkio_policy_node *oldpn,
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
 			oldpn->val.iops = newpn->val.iops;
+			break;
+		case BLKIO_THROTL_latency_target_device:
+			oldpn->val.latency = newpn->val.latency;
 		}
 		break;
 	default:
@@ -902,6 +949,10 @@ static void blkio_update_blkg_policy(struct blkio_cgroup *blkcg,
 			iops = pn->val.iops ? pn->val.iops : (-1);
 			blkio_update_group_iops(blkg, iops, pn->fileid);
 			break;
+		case BLKIO_THROTL_latency_target_device:
+			blkio_update_group_latency_target(blkg,
+							pn->val.latency);
+			break;
 		}
 		break;
 	default:
@@ -1012,6 +1063,10 @@ blkio_print_policy_node(struct seq_file *m, struct blkio_policy_node *pn)
 				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
 					MINOR(pn->dev), pn->val.iops);
 				break;
+			case BLKIO_THROTL_latency_target_device:
+				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
+					MINOR(pn->dev), pn->val.latency);
+				break;
 			}
 			break;
 		default:
@@ -1061,6 +1116,7 @@ static int blkiocg_file_read(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_write_bps_device:
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
+		case BLKIO_THROTL_latency_target_device:
 			blkio_read_policy_node_files(cft, blkcg, m);
 			return 0;
 		default:
@@ -1168,6 +1224,12 @@ static int blkiocg_file_read_map(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_io_serviced:
 			return blkio_read_blkg_stats(blkcg, cft, cb,
 						BLKIO_STAT_SERVICED, 1);
+		case BLKIO_THROTL_io_service_time:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_SERVICE_TIME, 1);
+		case BLKIO_THROTL_io_wait_time:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_WAIT_TIME, 1);
 		default:
 			BUG();
 		}
@@ -1364,6 +1426,26 @@ struct cftype blkio_files[] = {
 				BLKIO_THROTL_io_serviced),
 		.read_map = blkiocg_file_read_map,
 	},
+	{
+		.name = "throttle.latency_target_device",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_target_device),
+		.read_seq_string = blkiocg_file_read,
+		.write_string = blkiocg_file_write,
+		.max_write_len = 256,
+	},
+	{
+		.name = "throttle.io_service_time",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_io_service_time),
+		.read_map = blkiocg_file_read_map,
+	},
+	{
+		.name = "throttle.io_wait_time",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_io_wait_time),
+		.read_map = blkiocg_file_read_map,
+	},
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
 #ifdef CONFIG_DEBUG_BLK_CGROUP
@@ -22,6 +22,7 @@ enum blkio_policy_id {
 
 /* Max limits for throttle policy */
 #define THROTL_IOPS_MAX		UINT_MAX
+#define THROTL_LATENCY_MAX	UINT_MAX
 
 #if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
 
@@ -103,6 +104,9 @@ enum blkcg_file_name_throtl {
 	BLKIO_THROTL_write_iops_device,
 	BLKIO_THROTL_io_service_bytes,
 	BLKIO_THROTL_io_serviced,
+	BLKIO_THROTL_latency_target_device,
+	BLKIO_THROTL_io_service_time,
+	BLKIO_THROTL_io_wait_time,
 };
 
 struct blkio_cgroup {
@@ -179,6 +183,8 @@ struct blkio_policy_node {
 		 */
 		u64 bps;
 		unsigned int iops;
+		/* Completion latency target in usecs */
+		unsigned int latency;
 	} val;
 };
 
@@ -192,6 +198,8 @@ extern unsigned int blkcg_get_read_iops(struct blkio_cgroup *blkcg,
 				     dev_t dev);
 extern unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg,
 				     dev_t dev);
+extern unsigned int blkcg_get_latency_target(struct blkio_cgroup *blkcg,
+				     dev_t dev);
 
 typedef void (blkio_unlink_group_fn) (void *key, struct blkio_group *blkg);
 
@@ -205,6 +213,8 @@ typedef void (blkio_update_group_read_iops_fn) (void *key,
 			struct blkio_group *blkg, unsigned int read_iops);
 typedef void (blkio_update_group_write_iops_fn) (void *key,
 			struct blkio_group *blkg, unsigned int write_iops);
+typedef void (blkio_update_group_latency_target_fn) (void *key,
+			struct blkio_group *blkg, unsigned int latency);
 
 struct blkio_policy_ops {
 	blkio_unlink_group_fn *blkio_unlink_group_fn;
@@ -213,6 +223,7 @@ struct blkio_policy_ops {
 	blkio_update_group_write_bps_fn *blkio_update_group_write_bps_fn;
 	blkio_update_group_read_iops_fn *blkio_update_group_read_iops_fn;
 	blkio_update_group_write_iops_fn *blkio_update_group_write_iops_fn;
+	blkio_update_group_latency_target_fn *blkio_update_group_latency_target_fn;
 };
 
 struct blkio_policy_type {
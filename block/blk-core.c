@@ -601,6 +601,36 @@ blk_alloc_request(struct request_queue *q, int flags, int priv, gfp_t gfp_mask)
 	return rq;
 }
 
+/*
+ * Try to allocate and set up a request without dropping the queue lock.
+ * This only succeeds if memory is readily available and the elevator has
+ * all per-task state it needs already, and saves the queue lock round
+ * trip elevator setup would otherwise need for every request.
+ */
+static struct request *
+blk_alloc_request_locked(struct request_queue *q, int flags, int priv)
+{
+	struct request *rq;
+
+	rq = mempool_alloc(q->rq.rq_pool, GFP_NOWAIT | __GFP_NOWARN);
+	if (!rq)
+		return NULL;
+
+	blk_rq_init(q, rq);
+
+	rq->cmd_flags = flags | REQ_ALLOCED;
+
+	if (priv) {
+		if (elv_set_request_locked(q, rq)) {
+			mempool_free(rq, q->rq.rq_pool);
+			return NULL;
+		}
+		rq->cmd_flags |= REQ_ELVPRIV;
+	}
+
+	return rq;
+}
+
 /*
  * ioc_batching returns true if the ioc is a valid batching request and
  * should be given priority access to a request.
@@ -751,7 +781,11 @@ static struct request *get_request(struct request_queue *q, int rw_flags,
 
 	if (blk_queue_io_stat(q))
 		rw_flags |= REQ_IO_STAT;
+
+	rq = blk_alloc_request_locked(q, rw_flags, priv);
 	spin_unlock_irq(q->queue_lock);
+	if (likely(rq))
+		goto got_rq;
 
 	rq = blk_alloc_request(q, rw_flags, priv, gfp_mask);
 	if (unlikely(!rq)) {
@@ -779,6 +813,7 @@ rq_starved:
 		goto out;
 	}
 
+got_rq:
 	/*
 	 * ioc may be NULL here, and ioc_batching will be false. That's
 	 * OK, if the queue is under the request limit then requests need
@@ -788,6 +823,8 @@ rq_starved:
 	if (ioc_batching(q, ioc))
 		ioc->nr_batch_requests--;
 
+	blk_throtl_rq_init(q, rq, bio);
+
 	trace_block_getrq(q, bio, rw_flags & 1);
 out:
 	return rq;
@@ -1043,6 +1080,7 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 		return;
 
 	elv_completed_request(q, req);
+	blk_throtl_rq_put(req);
 
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
@@ -2236,6 +2274,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blk_throtl_rq_done(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
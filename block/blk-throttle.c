@@ -20,6 +20,12 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/* Latency targets are checked once per window */
+static unsigned long throtl_lat_window = HZ/10;	/* 100 ms */
+
+/* Never cut a background group below this rate (bytes per second) */
+#define THROTL_LAT_MIN_BPS	(512 * 1024)
+
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
 static void throtl_schedule_delayed_work(struct throtl_data *td,
@@ -78,6 +84,24 @@ struct throtl_grp {
 
 	/* Some throttle limits got updated for the group */
 	int limits_changed;
+
+	/* Completion latency target in usecs. 0 means no target */
+	unsigned int latency_target;
+
+	/* Latency (ns) and number of requests completed in this window */
+	u64 lat_sum;
+	unsigned int lat_nr;
+
+	/* Bytes dispatched in this window */
+	u64 lat_bytes;
+
+	/*
+	 * Bandwidth cap put on a group without a latency target because
+	 * some other group missed its target. -1 if not capped.
+	 * lat_bps_base is the rate the group was doing when it got capped.
+	 */
+	u64 lat_bps;
+	u64 lat_bps_base;
 };
 
 struct throtl_data
@@ -103,6 +127,12 @@ struct throtl_data
 	struct delayed_work throtl_work;
 
 	int limits_changed;
+
+	/* Number of groups which have a latency target */
+	unsigned int nr_lat_grps;
+
+	/* Start of current latency window */
+	unsigned long lat_window_start;
 };
 
 enum tg_state_flags {
@@ -145,6 +175,12 @@ static inline int total_nr_queued(struct throtl_data *td)
 	return (td->nr_queued[0] + td->nr_queued[1]);
 }
 
+/* Effective bps limit, taking the latency based cap into account */
+static inline u64 tg_bps(struct throtl_grp *tg, bool rw)
+{
+	return min(tg->bps[rw], tg->lat_bps);
+}
+
 static inline struct throtl_grp *throtl_ref_get_tg(struct throtl_grp *tg)
 {
 	atomic_inc(&tg->ref);
@@ -159,6 +195,8 @@ static void throtl_put_tg(struct throtl_grp *tg)
 	kfree(tg);
 }
 
+static void throtl_lat_recount(struct throtl_data *td);
+
 static struct throtl_grp * throtl_find_alloc_tg(struct throtl_data *td,
 			struct blkio_cgroup *blkcg)
 {
@@ -219,9 +257,13 @@ static struct throtl_grp * throtl_find_alloc_tg(struct throtl_data *td,
 	tg->bps[WRITE] = blkcg_get_write_bps(blkcg, tg->blkg.dev);
 	tg->iops[READ] = blkcg_get_read_iops(blkcg, tg->blkg.dev);
 	tg->iops[WRITE] = blkcg_get_write_iops(blkcg, tg->blkg.dev);
+	tg->latency_target = blkcg_get_latency_target(blkcg, tg->blkg.dev);
+	tg->lat_bps = -1;
 
 	hlist_add_head(&tg->tg_node, &td->tg_list);
 	td->nr_undestroyed_grps++;
+	if (tg->latency_target)
+		throtl_lat_recount(td);
 done:
 	return tg;
 }
@@ -425,7 +467,7 @@ throtl_trim_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
 
 	if (!nr_slices)
 		return;
-	tmp = tg->bps[rw] * throtl_slice * nr_slices;
+	tmp = tg_bps(tg, rw) * throtl_slice * nr_slices;
 	do_div(tmp, HZ);
 	bytes_trim = tmp;
 
@@ -517,7 +559,7 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 
 	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, throtl_slice);
 
-	tmp = tg->bps[rw] * jiffy_elapsed_rnd;
+	tmp = tg_bps(tg, rw) * jiffy_elapsed_rnd;
 	do_div(tmp, HZ);
 	bytes_allowed = tmp;
 
@@ -529,7 +571,7 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 
 	/* Calc approx time to dispatch */
 	extra_bytes = tg->bytes_disp[rw] + bio->bi_size - bytes_allowed;
-	jiffy_wait = div64_u64(extra_bytes * HZ, tg->bps[rw]);
+	jiffy_wait = div64_u64(extra_bytes * HZ, tg_bps(tg, rw));
 
 	if (!jiffy_wait)
 		jiffy_wait = 1;
@@ -563,7 +605,7 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
 
 	/* If tg->bps = -1, then BW is unlimited */
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
+	if (tg_bps(tg, rw) == -1 && tg->iops[rw] == -1) {
 		if (wait)
 			*wait = 0;
 		return 1;
@@ -607,6 +649,7 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 	/* Charge the bio to the group */
 	tg->bytes_disp[rw] += bio->bi_size;
 	tg->io_disp[rw]++;
+	tg->lat_bytes += bio->bi_size;
 
 	/*
 	 * TODO: This will take blkg->stats_lock. Figure out a way
@@ -744,6 +787,8 @@ static void throtl_process_limit_change(struct throtl_data *td)
 
 	throtl_log(td, "limits changed");
 
+	throtl_lat_recount(td);
+
 	hlist_for_each_entry_safe(tg, pos, n, &td->tg_list, tg_node) {
 		if (!tg->limits_changed)
 			continue;
@@ -752,8 +797,9 @@ static void throtl_process_limit_change(struct throtl_data *td)
 			continue;
 
 		throtl_log_tg(td, tg, "limit change rbps=%llu wbps=%llu"
-			" riops=%u wiops=%u", tg->bps[READ], tg->bps[WRITE],
-			tg->iops[READ], tg->iops[WRITE]);
+			" riops=%u wiops=%u lat=%u lat_bps=%llu",
+			tg->bps[READ], tg->bps[WRITE], tg->iops[READ],
+			tg->iops[WRITE], tg->latency_target, tg->lat_bps);
 
 		/*
 		 * Restart the slices for both READ and WRITES. It
@@ -842,6 +888,178 @@ throtl_schedule_delayed_work(struct throtl_data *td, unsigned long delay)
 	}
 }
 
+/*
+ * Recount groups with a latency target. If none are left, lift the caps
+ * we put on other groups as nobody is going to evaluate them any more.
+ * Call with queue lock held.
+ */
+static void throtl_lat_recount(struct throtl_data *td)
+{
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+	unsigned int nr = 0;
+	bool uncapped = false;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+		if (tg->latency_target)
+			nr++;
+
+	if (nr && !td->nr_lat_grps) {
+		/* First target showed up, start with a fresh window */
+		hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+			tg->lat_sum = 0;
+			tg->lat_nr = 0;
+			tg->lat_bytes = 0;
+		}
+		td->lat_window_start = jiffies;
+	}
+
+	td->nr_lat_grps = nr;
+	if (nr)
+		return;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		if (tg->lat_bps == -1)
+			continue;
+		tg->lat_bps = -1;
+		xchg(&tg->limits_changed, true);
+		uncapped = true;
+	}
+
+	if (uncapped) {
+		xchg(&td->limits_changed, true);
+		throtl_schedule_delayed_work(td, 0);
+	}
+}
+
+/*
+ * Scale the bandwidth cap of a group without a latency target. If a
+ * foreground group missed its target in the last window, halve the cap
+ * (starting from the rate the group was doing). Otherwise open it up by
+ * 25% until it is back to where it started, at which point it is lifted.
+ */
+static void throtl_lat_adjust_tg(struct throtl_data *td,
+		struct throtl_grp *tg, bool missed, unsigned long elapsed)
+{
+	u64 new_bps = tg->lat_bps;
+
+	if (missed) {
+		if (tg->lat_bps == -1) {
+			/* Idle group, nothing to take away */
+			if (!tg->lat_bytes)
+				return;
+			tg->lat_bps_base = div64_u64(tg->lat_bytes * HZ, elapsed);
+			new_bps = tg->lat_bps_base;
+		}
+		new_bps = max_t(u64, new_bps >> 1, THROTL_LAT_MIN_BPS);
+	} else if (tg->lat_bps != -1) {
+		new_bps = tg->lat_bps + (tg->lat_bps >> 2);
+		if (new_bps >= tg->lat_bps_base)
+			new_bps = -1;
+	}
+
+	if (new_bps == tg->lat_bps)
+		return;
+
+	throtl_log_tg(td, tg, "latency cap %llu -> %llu",
+			tg->lat_bps, new_bps);
+	tg->lat_bps = new_bps;
+	xchg(&tg->limits_changed, true);
+	xchg(&td->limits_changed, true);
+}
+
+/* Close the current latency window. Call with queue lock held. */
+static void throtl_lat_end_window(struct throtl_data *td)
+{
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+	unsigned long elapsed = jiffies - td->lat_window_start;
+	bool missed = false;
+	u64 avg;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		if (!tg->latency_target || !tg->lat_nr)
+			continue;
+
+		avg = div_u64(tg->lat_sum, tg->lat_nr);
+		if (avg > (u64)tg->latency_target * NSEC_PER_USEC) {
+			throtl_log_tg(td, tg, "latency target missed"
+				" avg=%lluus target=%uus nr=%u",
+				div_u64(avg, NSEC_PER_USEC),
+				tg->latency_target, tg->lat_nr);
+			missed = true;
+		}
+	}
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		if (!tg->latency_target)
+			throtl_lat_adjust_tg(td, tg, missed, elapsed);
+		tg->lat_sum = 0;
+		tg->lat_nr = 0;
+		tg->lat_bytes = 0;
+	}
+
+	td->lat_window_start = jiffies;
+
+	if (td->limits_changed)
+		throtl_schedule_delayed_work(td, 0);
+}
+
+/*
+ * Associate a freshly allocated request with the group of the submitting
+ * task so that its completion latency can be accounted. This is only done
+ * while some group on the queue has a latency target.
+ *
+ * Bios which were held back and are dispatched later from kthrotld get
+ * accounted to the root group, as the worker is the submitter then.
+ */
+void blk_throtl_rq_init(struct request_queue *q, struct request *rq,
+			struct bio *bio)
+{
+	struct throtl_data *td = q->td;
+
+	if (!bio || !td || !td->nr_lat_grps)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	rq->throtl_grp = throtl_ref_get_tg(throtl_get_tg(td));
+	spin_unlock_irq(q->queue_lock);
+}
+
+/* Request completed. Call with queue lock held. */
+void blk_throtl_rq_done(struct request *rq)
+{
+	struct throtl_grp *tg = rq->throtl_grp;
+	struct throtl_data *td = rq->q->td;
+	u64 now = sched_clock();
+	u64 start = rq_start_time_ns(rq);
+
+	if (!tg)
+		return;
+
+	blkiocg_update_completion_stats(&tg->blkg, start,
+			rq_io_start_time_ns(rq), rq_data_dir(rq),
+			rq_is_sync(rq));
+
+	if (time_after64(now, start)) {
+		tg->lat_sum += now - start;
+		tg->lat_nr++;
+	}
+
+	if (time_after_eq(jiffies, td->lat_window_start + throtl_lat_window))
+		throtl_lat_end_window(td);
+}
+
+void blk_throtl_rq_put(struct request *rq)
+{
+	struct throtl_grp *tg = rq->throtl_grp;
+
+	if (tg) {
+		rq->throtl_grp = NULL;
+		throtl_put_tg(tg);
+	}
+}
+
 static void
 throtl_destroy_tg(struct throtl_data *td, struct throtl_grp *tg)
 {
@@ -850,6 +1068,10 @@ throtl_destroy_tg(struct throtl_data *td, struct throtl_grp *tg)
 
 	hlist_del_init(&tg->tg_node);
 
+	/* tg is off tg_list already; recount before the put can free it */
+	if (tg->latency_target)
+		throtl_lat_recount(td);
+
 	/*
 	 * Put the reference taken at the time of creation so that when all
 	 * queues are gone, group can be destroyed.
@@ -961,6 +1183,16 @@ static void throtl_update_blkio_group_write_iops(void *key,
 	throtl_update_blkio_group_common(td, tg);
 }
 
+static void throtl_update_blkio_group_latency_target(void *key,
+			struct blkio_group *blkg, unsigned int latency)
+{
+	struct throtl_data *td = key;
+	struct throtl_grp *tg = tg_of_blkg(blkg);
+
+	tg->latency_target = latency;
+	throtl_update_blkio_group_common(td, tg);
+}
+
 static void throtl_shutdown_wq(struct request_queue *q)
 {
 	struct throtl_data *td = q->td;
@@ -979,6 +1211,8 @@ static struct blkio_policy_type blkio_policy_throtl = {
 					throtl_update_blkio_group_read_iops,
 		.blkio_update_group_write_iops_fn =
 					throtl_update_blkio_group_write_iops,
+		.blkio_update_group_latency_target_fn =
+				throtl_update_blkio_group_latency_target,
 	},
 	.plid = BLKIO_POLICY_THROTL,
 };
@@ -1071,7 +1305,9 @@ int blk_throtl_init(struct request_queue *q)
 	/* Practically unlimited BW */
 	tg->bps[0] = tg->bps[1] = -1;
 	tg->iops[0] = tg->iops[1] = -1;
+	tg->lat_bps = -1;
 	td->limits_changed = false;
+	td->lat_window_start = jiffies;
 
 	/*
 	 * Set root group reference to 2. One reference will be dropped when
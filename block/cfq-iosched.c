@@ -3734,6 +3734,54 @@ queue_fail:
 	return 1;
 }
 
+/*
+ * Fast path of cfq_set_request(), called with the queue lock held. This
+ * only handles the common case of a task which already has a cic and a
+ * cfqq for this queue, found through the lockless cic lookup. Anything
+ * that needs allocation or a cfqq split/merge is left to the slow path.
+ */
+static int cfq_set_request_locked(struct request_queue *q, struct request *rq)
+{
+	struct cfq_data *cfqd = q->elevator->elevator_data;
+	struct io_context *ioc = current->io_context;
+	const int rw = rq_data_dir(rq);
+	const bool is_sync = rq_is_sync(rq);
+	struct cfq_io_context *cic;
+	struct cfq_queue *cfqq;
+
+	if (!ioc)
+		return 1;
+
+	cic = cfq_cic_lookup(cfqd, ioc);
+	if (!cic)
+		return 1;
+
+	/* Updating prio or cgroup of the cics needs the queue lock dropped */
+	smp_read_barrier_depends();
+	if (unlikely(ioc->ioprio_changed))
+		return 1;
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	if (unlikely(ioc->cgroup_changed))
+		return 1;
+#endif
+
+	cfqq = cic_to_cfqq(cic, is_sync);
+	if (!cfqq || cfqq == &cfqd->oom_cfqq || cfqq->new_cfqq ||
+	    (cfq_cfqq_coop(cfqq) && cfq_cfqq_split_coop(cfqq)))
+		return 1;
+
+	/* ioc of current can't be going away, so no need for inc_not_zero */
+	atomic_long_inc(&ioc->refcount);
+
+	cfqq->allocated[rw]++;
+
+	cfqq->ref++;
+	rq->elevator_private[0] = cic;
+	rq->elevator_private[1] = cfqq;
+	rq->elevator_private[2] = cfq_ref_get_cfqg(cfqq->cfqg);
+	return 0;
+}
+
 static void cfq_kick_queue(struct work_struct *work)
 {
 	struct cfq_data *cfqd =
@@ -4106,6 +4154,7 @@ static struct elevator_type iosched_cfq = {
 		.elevator_former_req_fn =	elv_rb_former_request,
 		.elevator_latter_req_fn =	elv_rb_latter_request,
 		.elevator_set_req_fn =		cfq_set_request,
+		.elevator_set_req_locked_fn =	cfq_set_request_locked,
 		.elevator_put_req_fn =		cfq_put_request,
 		.elevator_may_queue_fn =	cfq_may_queue,
 		.elevator_init_fn =		cfq_init_queue,
@@ -777,6 +777,26 @@ int elv_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
 	return 0;
 }
 
+/*
+ * Like elv_set_request(), but called with the queue lock held and must not
+ * allocate. Returns non-zero if the elevator can't set up the request
+ * without dropping the lock, in which case the caller falls back to
+ * elv_set_request().
+ */
+int elv_set_request_locked(struct request_queue *q, struct request *rq)
+{
+	struct elevator_queue *e = q->elevator;
+
+	if (e->ops->elevator_set_req_locked_fn)
+		return e->ops->elevator_set_req_locked_fn(q, rq);
+
+	if (e->ops->elevator_set_req_fn)
+		return 1;
+
+	rq->elevator_private[0] = NULL;
+	return 0;
+}
+
 void elv_put_request(struct request_queue *q, struct request *rq)
 {
 	struct elevator_queue *e = q->elevator;
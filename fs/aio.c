@@ -35,6 +35,8 @@
 #include <linux/eventfd.h>
 #include <linux/blkdev.h>
 #include <linux/compat.h>
+#include <linux/pagemap.h>
+#include <linux/cred.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -49,12 +51,14 @@
 static DEFINE_SPINLOCK(aio_nr_lock);
 unsigned long aio_nr;		/* current system wide number of aio requests */
 unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio requests */
+int aio_buffered_async;		/* hand buffered i/o to aio_buffered_wq */
 /*----end sysctl variables---*/
 
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_buffered_wq;
 
 /* Used for rare fput completion. */
 static void aio_fput_routine(struct work_struct *);
@@ -77,6 +81,8 @@ static int __init aio_setup(void)
 
 	aio_wq = alloc_workqueue("aio", 0, 1);	/* used to limit concurrency */
 	BUG_ON(!aio_wq);
+	aio_buffered_wq = alloc_workqueue("aio_buffered", 0, 0);
+	BUG_ON(!aio_buffered_wq);
 
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
@@ -277,6 +283,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_mutex);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
@@ -1514,9 +1521,100 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 	return 0;
 }
 
+/*
+ * Reads entirely in the page cache complete quickly in the submitter,
+ * look at no more than this many pages to find out.
+ */
+#define AIO_CACHED_CHECK_PAGES	16
+
+static bool aio_range_cached(struct address_space *mapping, loff_t pos,
+			     size_t count)
+{
+	pgoff_t index, last;
+
+	if (!count)
+		return true;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	last = (pos + count - 1) >> PAGE_CACHE_SHIFT;
+	if (last - index >= AIO_CACHED_CHECK_PAGES)
+		return false;
+
+	for (; index <= last; index++) {
+		struct page *page = find_get_page(mapping, index);
+		bool uptodate = page && PageUptodate(page);
+
+		if (page)
+			page_cache_release(page);
+		if (!uptodate)
+			return false;
+	}
+	return true;
+}
+
+/* aio_buffered_punt
+ *	Buffered reads and writes of regular files run to completion in
+ *	the submitter's context, blocking on page cache misses and dirty
+ *	throttling.  Returns true if the kiocb should be handed to the
+ *	worker pool instead.  Writes are only handed off if there is no
+ *	file size limit, so that RLIMIT_FSIZE and SIGXFSZ keep applying
+ *	to the submitting task.  The workers' I/O is not accounted to the
+ *	submitter's blkio cgroup or io_context, which is why handing off
+ *	is off by default.
+ */
+static bool aio_buffered_punt(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+
+	if (!aio_buffered_async)
+		return false;
+	if ((file->f_flags & O_DIRECT) ||
+	    !S_ISREG(file->f_mapping->host->i_mode))
+		return false;
+
+	switch (iocb->ki_opcode) {
+	case IOCB_CMD_PREAD:
+	case IOCB_CMD_PREADV:
+		return !aio_range_cached(file->f_mapping, iocb->ki_pos,
+					 iocb->ki_left);
+	case IOCB_CMD_PWRITE:
+	case IOCB_CMD_PWRITEV:
+		return rlimit(RLIMIT_FSIZE) == RLIM_INFINITY;
+	}
+	return false;
+}
+
+/* aio_buffered_work
+ *	Worker pool handler for kiocbs handed off at submission.  Runs
+ *	the kiocb in the issuer's mm and with its credentials, then drops
+ *	the reference io_submit_one() held for the submission.
+ */
+static void aio_buffered_work(struct work_struct *work)
+{
+	struct kiocb *iocb = container_of(work, struct kiocb, ki_work);
+	struct kioctx *ctx = iocb->ki_ctx;
+	const struct cred *cred = iocb->ki_cred;
+	const struct cred *old_cred;
+	mm_segment_t oldfs = get_fs();
+	struct mm_struct *mm = ctx->mm;
+
+	old_cred = override_creds(cred);
+	set_fs(USER_DS);
+	use_mm(mm);
+	spin_lock_irq(&ctx->ctx_lock);
+	aio_run_iocb(iocb);
+	__aio_put_req(ctx, iocb);
+	spin_unlock_irq(&ctx->ctx_lock);
+	unuse_mm(mm);
+	set_fs(oldfs);
+	revert_creds(old_cred);
+	put_cred(cred);
+}
+
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 			 struct iocb *iocb, bool compat)
 {
+	bool punt;
 	struct kiocb *req;
 	struct file *file;
 	ssize_t ret;
@@ -1581,6 +1679,8 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	if (ret)
 		goto out_put_req;
 
+	punt = aio_buffered_punt(req);
+
 	spin_lock_irq(&ctx->ctx_lock);
 	/*
 	 * We could have raced with io_destroy() and are currently holding a
@@ -1599,6 +1699,14 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		ret = -EINVAL;
 		goto out_put_req;
 	}
+	if (punt) {
+		spin_unlock_irq(&ctx->ctx_lock);
+		/* aio_buffered_work() drops the extra ref to req */
+		req->ki_cred = get_current_cred();
+		INIT_WORK(&req->ki_work, aio_buffered_work);
+		queue_work(aio_buffered_wq, &req->ki_work);
+		return 0;
+	}
 	aio_run_iocb(req);
 	if (!list_empty(&ctx->run_list)) {
 		/* drain the run list */
@@ -1687,6 +1795,160 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	return do_io_submit(ctx_id, nr, iocbpp, 0);
 }
 
+/* aio_sq_drain
+ *	Submit the iocbs queued on the submission ring of ctx, up to the
+ *	tail published by userspace.  Stops at the first iocb that fails
+ *	to submit, leaving it at the head of the ring.  Returns the number
+ *	of iocbs submitted, or the error if none was.  Without wait, gives
+ *	up if another thread is draining the ring already.
+ */
+static long aio_sq_drain(struct kioctx *ctx, bool wait)
+{
+	struct aio_sq_ring __user *ring;
+	struct blk_plug plug;
+	unsigned head, tail;
+	long ret = 0;
+	long nr = 0;
+
+	if (wait)
+		mutex_lock(&ctx->sq_mutex);
+	else if (!mutex_trylock(&ctx->sq_mutex))
+		return 0;
+
+	ring = ctx->sq_ring;
+	ret = -EINVAL;
+	if (unlikely(!ring))
+		goto out;
+
+	ret = -EFAULT;
+	head = ctx->sq_head;
+	if (unlikely(get_user(tail, &ring->tail)))
+		goto out;
+	ret = -EINVAL;
+	if (unlikely(tail - head > ctx->sq_nr))
+		goto out;
+	/* Pairs with the barrier userspace issues before updating tail */
+	smp_rmb();
+
+	ret = 0;
+	blk_start_plug(&plug);
+	while (head != tail) {
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+		__u64 entry;
+
+		if (unlikely(copy_from_user(&entry,
+					    &ring->iocbs[head % ctx->sq_nr],
+					    sizeof(entry)))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		user_iocb = (struct iocb __user *)(unsigned long)entry;
+		if (user_iocb) {
+			if (unlikely(copy_from_user(&tmp, user_iocb,
+						    sizeof(tmp)))) {
+				ret = -EFAULT;
+				break;
+			}
+
+			ret = io_submit_one(ctx, user_iocb, &tmp,
+					    ctx->sq_compat);
+			if (ret)
+				break;
+			nr++;
+		}
+		head++;
+	}
+	blk_finish_plug(&plug);
+
+	ctx->sq_head = head;
+	if (unlikely(put_user(head, &ring->head)))
+		ret = -EFAULT;
+out:
+	mutex_unlock(&ctx->sq_mutex);
+	return nr ? nr : ret;
+}
+
+long do_io_sq_setup(aio_context_t ctx_id, struct aio_sq_ring __user *ring,
+		    unsigned nr, bool compat)
+{
+	struct kioctx *ctx;
+	long ret;
+
+	if (unlikely(!nr ||
+		     nr > (INT_MAX - sizeof(*ring)) / sizeof(ring->iocbs[0])))
+		return -EINVAL;
+
+	if (unlikely(!access_ok(VERIFY_WRITE, ring, sizeof(*ring) +
+				nr * sizeof(ring->iocbs[0]))))
+		return -EFAULT;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx)) {
+		pr_debug("EINVAL: io_sq_setup: invalid context id\n");
+		return -EINVAL;
+	}
+
+	mutex_lock(&ctx->sq_mutex);
+	ret = -EBUSY;
+	if (ctx->sq_ring)
+		goto out;
+
+	ret = -EFAULT;
+	if (put_user(0, &ring->head) || put_user(0, &ring->tail))
+		goto out;
+
+	ctx->sq_head = 0;
+	ctx->sq_nr = nr;
+	ctx->sq_compat = compat;
+	ctx->sq_ring = ring;
+	ret = 0;
+out:
+	mutex_unlock(&ctx->sq_mutex);
+	put_ioctx(ctx);
+	return ret;
+}
+
+/* sys_io_sq_setup:
+ *	Register the submission ring of nr entries at ring with the
+ *	aio_context specified by ctx_id, and reset its head and tail.
+ *	Iocbs queued on the ring are submitted by io_sq_enter(), and
+ *	before reaping events in io_getevents().  May fail with -EINVAL
+ *	if ctx_id is invalid or nr is out of range, with -EFAULT if the
+ *	ring is not writable, or with -EBUSY if the context has a ring
+ *	already.
+ */
+SYSCALL_DEFINE3(io_sq_setup, aio_context_t, ctx_id,
+		struct aio_sq_ring __user *, ring, unsigned, nr)
+{
+	return do_io_sq_setup(ctx_id, ring, nr, 0);
+}
+
+/* sys_io_sq_enter:
+ *	Submit the iocbs queued on the submission ring of the aio_context
+ *	specified by ctx_id.  Returns the number of iocbs submitted, which
+ *	may be less than queued if one of them failed, in which case it
+ *	is left at the head of the ring.  If none were submitted, returns
+ *	the error of the first one, as io_submit() would.  May fail with
+ *	-EINVAL if ctx_id is invalid or has no submission ring.
+ */
+SYSCALL_DEFINE1(io_sq_enter, aio_context_t, ctx_id)
+{
+	struct kioctx *ctx;
+	long ret;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx)) {
+		pr_debug("EINVAL: io_sq_enter: invalid context id\n");
+		return -EINVAL;
+	}
+
+	ret = aio_sq_drain(ctx, true);
+	put_ioctx(ctx);
+	return ret;
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
@@ -1789,8 +2051,12 @@ SYSCALL_DEFINE5(io_getevents, aio_context_t, ctx_id,
 	long ret = -EINVAL;
 
 	if (likely(ioctx)) {
-		if (likely(min_nr <= nr && min_nr >= 0))
+		if (likely(min_nr <= nr && min_nr >= 0)) {
+			/* Submit whatever is queued on the ring first */
+			if (ioctx->sq_ring)
+				aio_sq_drain(ioctx, false);
 			ret = read_events(ioctx, min_nr, nr, events, timeout);
+		}
 		put_ioctx(ioctx);
 	}
 
@@ -651,6 +651,13 @@ compat_sys_io_submit(aio_context_t ctx_id, int nr, u32 __user *iocb)
 	return ret;
 }
 
+asmlinkage long
+compat_sys_io_sq_setup(aio_context_t ctx_id, struct aio_sq_ring __user *ring,
+		       unsigned nr)
+{
+	return do_io_sq_setup(ctx_id, ring, nr, 1);
+}
+
 struct compat_ncp_mount_data {
 	compat_int_t version;
 	compat_uint_t ncp_fd;
@@ -45,18 +45,23 @@
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (spinlock)
+ * 3) ep->lock (rwlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
+ * We need a spinning lock (ep->lock) because we manipulate objects
  * from inside the poll callback, that might be triggered from
  * a wake_up() that in turn might be called from IRQ context.
  * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
- * user space) we could end up sleeping due a copy_to_user(), so
- * we need a lock that will allow us to sleep. This lock is a
- * mutex (ep->mtx). It is acquired during the event transfer loop,
- * during epoll_ctl(EPOLL_CTL_DEL) and during eventpoll_release_file().
+ * a spinning lock. The poll callback takes ep->lock for reading
+ * only and queues items with lockless list operations, so that
+ * wakeups coming from many CPUs at once do not serialize on it;
+ * every other user takes it for writing, which excludes all the
+ * callbacks while the ready list is being spliced. During the event
+ * transfer loop (from kernel to user space) we could end up sleeping
+ * due a copy_to_user(), so we need a lock that will allow us to sleep.
+ * This lock is a mutex (ep->mtx). It is acquired during the event
+ * transfer loop, during epoll_ctl(EPOLL_CTL_DEL) and during
+ * eventpoll_release_file().
  * Then we also need a global mutex to serialize eventpoll_release_file()
  * and ep_free().
  * This mutex is acquired by ep_free() during the epoll file
@@ -79,13 +84,22 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+#define EPOLLINOUT_BITS (POLLIN | POLLOUT)
+
+/* Event bits that may be combined with EPOLLEXCLUSIVE */
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | POLLERR | POLLHUP | \
+				EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
 
 #define EP_MAX_EVENTS (INT_MAX / sizeof(struct epoll_event))
 
+/* Maximum number of operations in a single epoll_ctl_batch() call */
+#define EP_MAX_BATCH 1024
+
 #define EP_UNACTIVE_PTR ((void *) -1L)
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
@@ -156,8 +170,11 @@ struct epitem {
  * interface.
  */
 struct eventpoll {
-	/* Protect the access to this structure */
-	spinlock_t lock;
+	/*
+	 * Protect the access to this structure. Taken for reading by the
+	 * poll callback and for writing everywhere else.
+	 */
+	rwlock_t lock;
 
 	/*
 	 * This mutex is used to ensure that files are not removed
@@ -325,7 +342,70 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty_careful(&ep->rdllist) ||
+		ACCESS_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+}
+
+/*
+ * Adds a new entry to the tail of the list in a lockless way, i.e.
+ * multiple CPUs are allowed to call this function concurrently, as long
+ * as they all hold "ep->lock" for reading and nobody else touches the
+ * list. Returns false if the entry has just been queued by another CPU.
+ */
+static inline bool list_add_tail_lockless(struct list_head *new,
+					  struct list_head *head)
+{
+	struct list_head *prev;
+
+	/*
+	 * This is simple 'new->next = head' operation, but cmpxchg()
+	 * is used in order to detect that same element has been just
+	 * added to the list from another CPU: the winner observes
+	 * new->next == new.
+	 */
+	if (cmpxchg(&new->next, new, head) != new)
+		return false;
+
+	/*
+	 * Initially ->next of a new element must be updated with the head
+	 * (we are inserting to the tail) and only then pointers are atomically
+	 * exchanged. xchg() implies a full barrier, thus ->next is updated
+	 * before the tail is swapped, and the tail is swapped before
+	 * prev->next is updated.
+	 */
+	prev = xchg(&head->prev, new);
+
+	/*
+	 * It is safe to modify prev->next and new->prev, because a new element
+	 * is added only to the tail and new->next is updated before xchg().
+	 */
+	prev->next = new;
+	new->prev = prev;
+
+	return true;
+}
+
+/*
+ * Chains an item on ep->ovflist in a lockless way, with the same rules
+ * as list_add_tail_lockless(). Returns false if the item is already
+ * chained.
+ */
+static inline bool chain_epi_lockless(struct epitem *epi)
+{
+	struct eventpoll *ep = epi->ep;
+
+	/* Fast preliminary check */
+	if (epi->next != EP_UNACTIVE_PTR)
+		return false;
+
+	/* Check that the same epi has not been just chained from another CPU */
+	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
+		return false;
+
+	/* Atomically exchange the head */
+	epi->next = xchg(&ep->ovflist, epi);
+
+	return true;
 }
 
 /**
@@ -491,17 +571,17 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 * because we want the "sproc" callback to be able to do it
 	 * in a lockless way.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	list_splice_init(&ep->rdllist, &txlist);
 	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	/*
 	 * Now call the callback function.
 	 */
 	error = (*sproc)(ep, &txlist, priv);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
@@ -536,11 +616,11 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	mutex_unlock(&ep->mtx);
 
@@ -578,10 +658,10 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	/* At this point it is safe to free the eventpoll item */
 	kmem_cache_free(epi_cache, epi);
@@ -757,7 +837,7 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
-	spin_lock_init(&ep->lock);
+	rwlock_init(&ep->lock);
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
@@ -808,6 +888,17 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * This callback takes a read lock in order not to contend with concurrent
+ * events from another file descriptor, thus all modifications to ->rdllist
+ * or ->ovflist are lockless. Read lock is paired with the write lock from
+ * ep_scan_ready_list(), which stops all list modifications and guarantees
+ * that lists state is seen correctly.
+ *
+ * Items registered with EPOLLEXCLUSIVE are hooked as exclusive waiters on
+ * the target wait queue, so the return value matters: returning zero tells
+ * the waker to go on with the next exclusive waiter, because nobody has
+ * been woken up through this one.
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
@@ -815,8 +906,9 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
+	int ewake = 0;
 
-	spin_lock_irqsave(&ep->lock, flags);
+	read_lock_irqsave(&ep->lock, flags);
 
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
@@ -842,35 +934,41 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * semantics). All the events that happen during that period of time are
 	 * chained in ep->ovflist and requeued later on.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-		}
-		goto out_unlock;
+	if (unlikely(ACCESS_ONCE(ep->ovflist) != EP_UNACTIVE_PTR)) {
+		chain_epi_lockless(epi);
+	} else if (!ep_is_linked(&epi->rdllink)) {
+		/* If this file is already in the ready list we exit soon */
+		list_add_tail_lockless(&epi->rdllink, &ep->rdllist);
 	}
 
-	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink))
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+	/*
+	 * Pairs with set_current_state() in ep_poll(): either the sleeper
+	 * sees the item we just queued, or we see the sleeper on ep->wq.
+	 */
+	smp_mb();
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+	if (waitqueue_active(&ep->wq)) {
+		ewake = 1;
+		wake_up(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
 out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
+	read_unlock_irqrestore(&ep->lock, flags);
 
 	/* We have to call this outside the lock */
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
+
+	return ewake;
 }
 
 /*
@@ -887,7 +985,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -977,7 +1078,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_rbtree_insert(ep, epi);
 
 	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
@@ -985,12 +1086,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 		/* Notify waiting tasks that events are available */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	atomic_long_inc(&ep->user->epoll_watches);
 
@@ -1009,10 +1110,10 @@ error_unregister:
 	 * list, since that is used/cleaned only inside a section bound by "mtx".
 	 * And ep_insert() is called with "mtx" held.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	kmem_cache_free(epi_cache, epi);
 
@@ -1033,9 +1134,15 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * otherwise we might miss an event that happens between the
 	 * f_op->poll() call and the new event set registering.
 	 */
-	epi->event.events = event->events;
+	epi->event.events = event->events; /* need barrier below */
 	epi->event.data = event->data; /* protected by mtx */
 
+	/*
+	 * The poll callback reads ->event.events without "ep->lock" held for
+	 * writing; make sure the new mask is visible before f_op->poll().
+	 */
+	smp_mb();
+
 	/*
 	 * Get current event bits. We can safely use the file* here because
 	 * its usage count has been increased by the caller of this function.
@@ -1047,17 +1154,17 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * list, push it inside.
 	 */
 	if (revents & event->events) {
-		spin_lock_irq(&ep->lock);
+		write_lock_irq(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 
 			/* Notify waiting tasks that events are available */
 			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+				wake_up(&ep->wq);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
-		spin_unlock_irq(&ep->lock);
+		write_unlock_irq(&ep->lock);
 	}
 
 	/* We have to call this outside the lock */
@@ -1169,7 +1276,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res = 0, eavail, timed_out = 0;
-	unsigned long flags;
 	long slack = 0;
 	wait_queue_t wait;
 	ktime_t expires, *to = NULL;
@@ -1186,21 +1292,20 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
-	spin_lock_irqsave(&ep->lock, flags);
-
 	if (!ep_events_available(ep)) {
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
+		 * Waiters are exclusive, so a single event wakes up a single
+		 * thread even when many of them share this epoll file.
 		 */
 		init_waitqueue_entry(&wait, current);
-		__add_wait_queue_exclusive(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1216,13 +1321,10 @@ fetch_events:
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
-
-			spin_lock_irqsave(&ep->lock, flags);
 		}
-		__remove_wait_queue(&ep->wq, &wait);
+		remove_wait_queue(&ep->wq, &wait);
 
 		set_current_state(TASK_RUNNING);
 	}
@@ -1230,8 +1332,6 @@ check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
 	 * there's still timeout left over, we go trying again in search of
@@ -1339,6 +1439,88 @@ SYSCALL_DEFINE1(epoll_create, int, size)
 	return sys_epoll_create1(0);
 }
 
+/*
+ * Validates an epoll_ctl() request against the eventpoll file @file and
+ * the target file @tfile, before any lock is taken.
+ */
+static int ep_ctl_check(struct file *file, struct file *tfile, int op,
+			struct epoll_event *epds)
+{
+	/* The target file descriptor must support poll */
+	if (!tfile->f_op || !tfile->f_op->poll)
+		return -EPERM;
+
+	/*
+	 * We have to check that the file structure underneath the file descriptor
+	 * the user passed to us _is_ an eventpoll file. And also we do not permit
+	 * adding an epoll file descriptor inside itself.
+	 */
+	if (file == tfile || !is_file_epoll(file))
+		return -EINVAL;
+
+	/*
+	 * EPOLLEXCLUSIVE only makes sense at insertion time, it can't be
+	 * combined with EPOLLONESHOT, and nested epoll files can't be
+	 * watched exclusively since their wakeups are not exclusive anyway.
+	 */
+	if (ep_op_has_event(op) && (epds->events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			return -EINVAL;
+		if (op == EPOLL_CTL_ADD && (is_file_epoll(tfile) ||
+				(epds->events & ~EPOLLEXCLUSIVE_OK_BITS)))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Applies a single insertion/removal/change to the interest set of @ep.
+ * Must be called with "mtx" held, and with "epmutex" held too when an
+ * epoll file is being inserted.
+ */
+static int ep_ctl_locked(struct eventpoll *ep, int op, struct file *tfile,
+			 int fd, struct epoll_event *epds)
+{
+	int error;
+	struct epitem *epi;
+
+	/*
+	 * Try to lookup the file inside our RB tree, Since we hold "mtx",
+	 * we can be sure to be able to use the item looked up by
+	 * ep_find() till the mutex is released.
+	 */
+	epi = ep_find(ep, tfile, fd);
+
+	error = -EINVAL;
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (!epi) {
+			epds->events |= POLLERR | POLLHUP;
+			error = ep_insert(ep, epds, tfile, fd);
+		} else
+			error = -EEXIST;
+		break;
+	case EPOLL_CTL_DEL:
+		if (epi)
+			error = ep_remove(ep, epi);
+		else
+			error = -ENOENT;
+		break;
+	case EPOLL_CTL_MOD:
+		if (epi) {
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds->events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, epds);
+			}
+		} else
+			error = -ENOENT;
+		break;
+	}
+
+	return error;
+}
+
 /*
  * The following function implements the controller interface for
  * the eventpoll file that enables the insertion/removal/change of
@@ -1351,7 +1533,6 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	int did_lock_epmutex = 0;
 	struct file *file, *tfile;
 	struct eventpoll *ep;
-	struct epitem *epi;
 	struct epoll_event epds;
 
 	error = -EFAULT;
@@ -1370,18 +1551,8 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (!tfile)
 		goto error_fput;
 
-	/* The target file descriptor must support poll */
-	error = -EPERM;
-	if (!tfile->f_op || !tfile->f_op->poll)
-		goto error_tgt_fput;
-
-	/*
-	 * We have to check that the file structure underneath the file descriptor
-	 * the user passed to us _is_ an eventpoll file. And also we do not permit
-	 * adding an epoll file descriptor inside itself.
-	 */
-	error = -EINVAL;
-	if (file == tfile || !is_file_epoll(file))
+	error = ep_ctl_check(file, tfile, op, &epds);
+	if (error)
 		goto error_tgt_fput;
 
 	/*
@@ -1410,47 +1581,137 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 
 
 	mutex_lock(&ep->mtx);
+	error = ep_ctl_locked(ep, op, tfile, fd, &epds);
+	mutex_unlock(&ep->mtx);
+
+error_tgt_fput:
+	if (unlikely(did_lock_epmutex))
+		mutex_unlock(&epmutex);
+
+	fput(tfile);
+error_fput:
+	fput(file);
+error_return:
+
+	return error;
+}
+
+/*
+ * Vectored version of epoll_ctl(). All the @ncmds operations in @cmds are
+ * applied in order under a single acquisition of "mtx" (and of "epmutex",
+ * if any of them inserts an epoll file), and the outcome of each one is
+ * stored in its ->result field. A failing entry does not stop the batch.
+ * Returns the number of entries that succeeded, or a negative error code
+ * if the batch as a whole could not be processed.
+ */
+SYSCALL_DEFINE4(epoll_ctl_batch, int, epfd, int, flags, int, ncmds,
+		struct epoll_ctl_cmd __user *, cmds)
+{
+	int i, error, done = 0;
+	int did_lock_epmutex = 0;
+	struct file *file;
+	struct file **tfiles;
+	struct eventpoll *ep;
+	struct epoll_ctl_cmd *kcmds;
+	struct epoll_event epds;
+	size_t size;
+
+	if (flags || ncmds <= 0 || ncmds > EP_MAX_BATCH)
+		return -EINVAL;
+
+	size = ncmds * sizeof(*kcmds);
+	kcmds = kmalloc(size, GFP_KERNEL);
+	tfiles = kcalloc(ncmds, sizeof(*tfiles), GFP_KERNEL);
+	error = -ENOMEM;
+	if (!kcmds || !tfiles)
+		goto error_free;
+
+	error = -EFAULT;
+	if (copy_from_user(kcmds, cmds, size))
+		goto error_free;
+
+	/* Get the "struct file *" for the eventpoll file */
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto error_free;
+
+	error = -EINVAL;
+	if (!is_file_epoll(file))
+		goto error_fput;
+	ep = file->private_data;
 
 	/*
-	 * Try to lookup the file inside our RB tree, Since we grabbed "mtx"
-	 * above, we can be sure to be able to use the item looked up by
-	 * ep_find() till we release the mutex.
+	 * Look up and validate all the targets before taking any lock. Entries
+	 * that fail here keep their error in ->result and are skipped below.
 	 */
-	epi = ep_find(ep, tfile, fd);
+	for (i = 0; i < ncmds; i++) {
+		struct epoll_ctl_cmd *cmd = &kcmds[i];
+
+		epds.events = cmd->events;
+		tfiles[i] = fget(cmd->fd);
+		if (!tfiles[i]) {
+			cmd->result = -EBADF;
+			continue;
+		}
+		cmd->result = ep_ctl_check(file, tfiles[i], cmd->op, &epds);
+		if (cmd->result) {
+			fput(tfiles[i]);
+			tfiles[i] = NULL;
+			continue;
+		}
+		if (unlikely(is_file_epoll(tfiles[i]) &&
+			     cmd->op == EPOLL_CTL_ADD)) {
+			/* See epoll_ctl() about why "epmutex" is needed here */
+			if (!did_lock_epmutex) {
+				mutex_lock(&epmutex);
+				did_lock_epmutex = 1;
+			}
+			if (ep_loop_check(ep, tfiles[i]) != 0) {
+				cmd->result = -ELOOP;
+				fput(tfiles[i]);
+				tfiles[i] = NULL;
+			}
+		}
+	}
 
-	error = -EINVAL;
-	switch (op) {
-	case EPOLL_CTL_ADD:
-		if (!epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_insert(ep, &epds, tfile, fd);
-		} else
-			error = -EEXIST;
-		break;
-	case EPOLL_CTL_DEL:
-		if (epi)
-			error = ep_remove(ep, epi);
-		else
-			error = -ENOENT;
-		break;
-	case EPOLL_CTL_MOD:
-		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
-		} else
-			error = -ENOENT;
-		break;
+	mutex_lock(&ep->mtx);
+	for (i = 0; i < ncmds; i++) {
+		struct epoll_ctl_cmd *cmd = &kcmds[i];
+
+		if (!tfiles[i])
+			continue;
+		epds.events = cmd->events;
+		epds.data = cmd->data;
+		cmd->result = ep_ctl_locked(ep, cmd->op, tfiles[i], cmd->fd,
+					    &epds);
 	}
 	mutex_unlock(&ep->mtx);
 
-error_tgt_fput:
 	if (unlikely(did_lock_epmutex))
 		mutex_unlock(&epmutex);
 
-	fput(tfile);
+	for (i = 0; i < ncmds; i++) {
+		if (tfiles[i])
+			fput(tfiles[i]);
+		if (!kcmds[i].result)
+			done++;
+	}
+
+	/*
+	 * The operations have been applied already, so a fault while
+	 * reporting the results can only be returned as such.
+	 */
+	error = done;
+	for (i = 0; i < ncmds; i++)
+		if (put_user(kcmds[i].result, &cmds[i].result))
+			error = -EFAULT;
+
 error_fput:
 	fput(file);
-error_return:
+error_free:
+	kfree(tfiles);
+	kfree(kcmds);
 
 	return error;
 }
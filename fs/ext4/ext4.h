@@ -77,6 +77,8 @@ typedef __u32 ext4_lblk_t;
 /* data type for block group number */
 typedef unsigned int ext4_group_t;
 
+#include "extents_status.h"
+
 /*
  * Flags used in mballoc's allocation_context flags field.
  *
@@ -541,6 +543,8 @@ struct ext4_new_group_data {
  /* note ioctl 11 reserved for filesystem-independent FIEMAP ioctl */
 #define EXT4_IOC_ALLOC_DA_BLKS		_IO('f', 12)
 #define EXT4_IOC_MOVE_EXT		_IOWR('f', 15, struct move_extent)
+ /* local to this tree, numbered well clear of upstream's */
+#define EXT4_IOC_FC_AREA		_IOW('f', 100, __u32)
 
 #if defined(__KERNEL__) && defined(CONFIG_COMPAT)
 /*
@@ -858,6 +862,25 @@ struct ext4_inode_info {
 	 */
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
+
+	/*
+	 * Fast commit state: checksum of the on-disk inode as of the start
+	 * of transaction i_fc_base_tid, and the last transaction which made
+	 * a change a fast commit cannot describe.  [i_fc_lock]
+	 */
+	spinlock_t i_fc_lock;
+	tid_t i_fc_base_tid;
+	u32 i_fc_base_csum;
+	tid_t i_fc_ineligible_tid;
+
+	/*
+	 * Extent status tree; i_es_lru_nr counts the entries the shrinker
+	 * may reclaim.  [i_es_lock]
+	 */
+	struct ext4_es_tree i_es_tree;
+	rwlock_t i_es_lock;
+	struct list_head i_es_lru;
+	unsigned int i_es_lru_nr;
 };
 
 /*
@@ -909,6 +932,8 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DISCARD		0x40000000 /* Issue DISCARD requests */
 #define EXT4_MOUNT_INIT_INODE_TABLE	0x80000000 /* Initialize uninitialized itables */
 
+#define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000001 /* Fast commits for fsync */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1110,6 +1135,7 @@ struct ext4_sb_info {
 	struct percpu_counter s_freeinodes_counter;
 	struct percpu_counter s_dirs_counter;
 	struct percpu_counter s_dirtyblocks_counter;
+	struct percpu_counter s_extent_cache_cnt;
 	struct blockgroup_lock *s_blockgroup_lock;
 	struct proc_dir_entry *s_proc;
 	struct kobject s_kobj;
@@ -1173,6 +1199,7 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_lg_fast;	/* served from a per-cpu reserved extent */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1201,6 +1228,11 @@ struct ext4_sb_info {
 	struct ext4_li_request *s_li_request;
 	/* Wait multiplier for lazy initialization thread */
 	unsigned int s_li_wait_mult;
+
+	/* Reclaim of extent status trees */
+	struct shrinker s_es_shrinker;
+	struct list_head s_es_lru;	/* inodes with reclaimable entries */
+	spinlock_t s_es_lru_lock;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1240,6 +1272,7 @@ enum {
 	EXT4_STATE_DIO_UNWRITTEN,	/* need convert on dio done*/
 	EXT4_STATE_NEWENTRY,		/* File just added to dir */
 	EXT4_STATE_DELALLOC_RESERVED,	/* blks already reserved for delalloc */
+	EXT4_STATE_FC_BASE,		/* i_fc_base_{tid,csum} are valid */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -1397,6 +1430,11 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_DEF_MIN_BATCH_TIME	0
 #define EXT4_DEF_MAX_BATCH_TIME	15000 /* 15ms */
 
+/*
+ * Journal blocks set aside for fast commits
+ */
+#define EXT4_DEF_FC_BLOCKS	256
+
 /*
  * Minimum number of groups in a flexgroup before we separate out
  * directories into the first block group of a flexgroup
@@ -1670,6 +1708,12 @@ extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 extern int ext4_sync_file(struct file *, int);
 extern int ext4_flush_completed_IO(struct inode *);
 
+/* fast_commit.c */
+extern void ext4_fc_track_inode(handle_t *, struct inode *,
+				struct ext4_inode *);
+extern int ext4_fc_commit(struct inode *, tid_t);
+extern void ext4_fc_replay(struct super_block *);
+
 /* hash.c */
 extern int ext4fs_dirhash(const char *name, int len, struct
 			  dx_hash_info *hinfo);
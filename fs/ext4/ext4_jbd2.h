@@ -263,6 +263,18 @@ static inline void ext4_update_inode_fsync_trans(handle_t *handle,
 	}
 }
 
+/*
+ * Record that @inode was changed in a way a fast commit cannot describe,
+ * so fsync must commit the running transaction in full.
+ */
+static inline void ext4_fc_mark_ineligible(handle_t *handle,
+					   struct inode *inode)
+{
+	if (ext4_handle_valid(handle) && inode)
+		EXT4_I(inode)->i_fc_ineligible_tid =
+			handle->h_transaction->t_tid;
+}
+
 /* super.c */
 int ext4_force_commit(struct super_block *sb);
 
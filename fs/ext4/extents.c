@@ -2000,6 +2000,7 @@ ext4_ext_put_gap_in_cache(struct inode *inode, struct ext4_ext_path *path,
 
 	ext_debug(" -> %u:%lu\n", lblock, len);
 	ext4_ext_put_in_cache(inode, lblock, len, 0);
+	ext4_es_insert_extent(inode, lblock, len, 0, EXTENT_STATUS_HOLE);
 }
 
 /*
@@ -3379,8 +3380,14 @@ int ext4_ext_map_blocks(handle_t *handle, struct inode *inode,
 			if (!ext4_ext_is_uninitialized(ex)) {
 				ext4_ext_put_in_cache(inode, ee_block,
 							ee_len, ee_start);
+				ext4_es_insert_extent(inode, ee_block, ee_len,
+						ee_start, EXTENT_STATUS_WRITTEN);
 				goto out;
 			}
+			/* ... but the extent status tree can hold them */
+			if (!(flags & EXT4_GET_BLOCKS_CREATE))
+				ext4_es_insert_extent(inode, ee_block, ee_len,
+						ee_start, EXTENT_STATUS_UNWRITTEN);
 			ret = ext4_ext_handle_uninitialized_extents(handle,
 					inode, map, path, flags, allocated,
 					newblock);
@@ -3565,6 +3572,10 @@ void ext4_ext_truncate(struct inode *inode)
 
 	ext4_discard_preallocations(inode);
 
+	last_block = (inode->i_size + sb->s_blocksize - 1)
+			>> EXT4_BLOCK_SIZE_BITS(sb);
+	ext4_es_remove_extent(inode, last_block, EXT_MAX_BLOCK - last_block);
+
 	/*
 	 * TODO: optimization is possible here.
 	 * Probably we need not scan at all,
@@ -3575,8 +3586,6 @@ void ext4_ext_truncate(struct inode *inode)
 	EXT4_I(inode)->i_disksize = inode->i_size;
 	ext4_mark_inode_dirty(handle, inode);
 
-	last_block = (inode->i_size + sb->s_blocksize - 1)
-			>> EXT4_BLOCK_SIZE_BITS(sb);
 	err = ext4_ext_remove_space(inode, last_block);
 
 	/* In a multi-transaction truncate, we only make the final
@@ -0,0 +1,440 @@
+/*
+ *  fs/ext4/extents_status.c
+ *
+ * Per-inode rbtree of extent status, so that block mapping, delayed
+ * allocation and SEEK_DATA/SEEK_HOLE do not have to walk the on-disk
+ * extent tree, and its buffer heads, again and again.
+ *
+ * The tree is protected by i_es_lock.  Entries never overlap.  Callers
+ * which change the on-disk mapping (block allocation, unwritten extent
+ * conversion, truncate, extent migration) hold i_data_sem for write and
+ * remove the affected range, so lookups done without i_data_sem see
+ * either the old or the new state, just as they would on disk.  Entries
+ * derived from the on-disk tree are only inserted while i_data_sem is
+ * held, which keeps a racing truncate from being undone by a stale
+ * insert.
+ *
+ * Everything but delayed extents can be reclaimed by the shrinker.
+ */
+
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include "ext4.h"
+#include "extents_status.h"
+
+#define ES_MAX_LBLK	((ext4_lblk_t)~0U)
+
+static struct kmem_cache *ext4_es_cachep;
+
+int __init ext4_init_es(void)
+{
+	ext4_es_cachep = KMEM_CACHE(extent_status, SLAB_RECLAIM_ACCOUNT);
+	if (ext4_es_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void ext4_exit_es(void)
+{
+	if (ext4_es_cachep)
+		kmem_cache_destroy(ext4_es_cachep);
+}
+
+void ext4_es_init_tree(struct ext4_es_tree *tree)
+{
+	tree->root = RB_ROOT;
+	tree->cache_es = NULL;
+}
+
+static inline ext4_lblk_t ext4_es_end(struct extent_status *es)
+{
+	return es->es_lblk + es->es_len - 1;
+}
+
+/* Clamp @len so that the range never wraps past the last logical block */
+static inline ext4_lblk_t ext4_es_clamp_len(ext4_lblk_t lblk, ext4_lblk_t len)
+{
+	if (len > ES_MAX_LBLK - lblk)
+		len = ES_MAX_LBLK - lblk;
+	return len;
+}
+
+static inline int ext4_es_is_mapped(unsigned int status)
+{
+	return status & (EXTENT_STATUS_WRITTEN | EXTENT_STATUS_UNWRITTEN);
+}
+
+/*
+ * Everything below runs under write_lock(&ei->i_es_lock).  New entries
+ * come from nodes the caller allocated beforehand, so that a delayed
+ * extent can always be recorded or split.
+ */
+static void ext4_es_account(struct inode *inode, struct extent_status *es,
+			    int delta)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (ext4_es_is_delayed(es))
+		return;
+	ei->i_es_lru_nr += delta;
+	percpu_counter_add(&sbi->s_extent_cache_cnt, delta);
+	if (delta > 0 && list_empty(&ei->i_es_lru)) {
+		spin_lock(&sbi->s_es_lru_lock);
+		list_add_tail(&ei->i_es_lru, &sbi->s_es_lru);
+		spin_unlock(&sbi->s_es_lru_lock);
+	}
+}
+
+static void ext4_es_erase(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+
+	rb_erase(&es->rb_node, &tree->root);
+	if (tree->cache_es == es)
+		tree->cache_es = NULL;
+	ext4_es_account(inode, es, -1);
+	kmem_cache_free(ext4_es_cachep, es);
+}
+
+static struct extent_status *ext4_es_next(struct extent_status *es)
+{
+	struct rb_node *node = rb_next(&es->rb_node);
+
+	return node ? rb_entry(node, struct extent_status, rb_node) : NULL;
+}
+
+static struct extent_status *ext4_es_prev(struct extent_status *es)
+{
+	struct rb_node *node = rb_prev(&es->rb_node);
+
+	return node ? rb_entry(node, struct extent_status, rb_node) : NULL;
+}
+
+/*
+ * Return the extent containing @lblk or, failing that, the first extent
+ * after it.
+ */
+static struct extent_status *__es_tree_search(struct rb_root *root,
+					      ext4_lblk_t lblk)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_status *es = NULL;
+
+	while (node) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es))
+			node = node->rb_right;
+		else
+			return es;
+	}
+
+	if (es && lblk > ext4_es_end(es))
+		es = ext4_es_next(es);
+	return es;
+}
+
+static int ext4_es_can_merge(struct extent_status *es1,
+			     struct extent_status *es2)
+{
+	if (es1->es_status != es2->es_status)
+		return 0;
+	if (ext4_es_end(es1) + 1 != es2->es_lblk)
+		return 0;
+	if ((u64)es1->es_len + es2->es_len >= ES_MAX_LBLK)
+		return 0;
+	if (ext4_es_is_mapped(es1->es_status) &&
+	    es1->es_pblk + es1->es_len != es2->es_pblk)
+		return 0;
+	return 1;
+}
+
+static void __es_insert(struct inode *inode, struct extent_status *new)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct rb_node **p = &tree->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+		if (new->es_lblk < es->es_lblk)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, &tree->root);
+	ext4_es_account(inode, new, 1);
+
+	es = ext4_es_prev(new);
+	if (es && ext4_es_can_merge(es, new)) {
+		es->es_len += new->es_len;
+		ext4_es_erase(inode, new);
+		new = es;
+	}
+	es = ext4_es_next(new);
+	if (es && ext4_es_can_merge(new, es)) {
+		new->es_len += es->es_len;
+		ext4_es_erase(inode, es);
+	}
+	tree->cache_es = new;
+}
+
+static void __es_remove(struct inode *inode, ext4_lblk_t lblk,
+			ext4_lblk_t end, struct extent_status **spare)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es, *next, *split;
+	ext4_lblk_t es_end, delta;
+
+	es = __es_tree_search(&tree->root, lblk);
+	while (es && es->es_lblk <= end) {
+		es_end = ext4_es_end(es);
+		next = ext4_es_next(es);
+
+		if (es->es_lblk < lblk) {
+			if (es_end > end) {
+				/* the range is in the middle of @es */
+				split = *spare;
+				*spare = NULL;
+				BUG_ON(!split);
+				delta = end + 1 - es->es_lblk;
+				split->es_lblk = end + 1;
+				split->es_len = es_end - end;
+				split->es_status = es->es_status;
+				split->es_pblk = ext4_es_is_mapped(es->es_status) ?
+						 es->es_pblk + delta : 0;
+				es->es_len = lblk - es->es_lblk;
+				__es_insert(inode, split);
+				return;
+			}
+			es->es_len = lblk - es->es_lblk;
+		} else if (es_end > end) {
+			delta = end + 1 - es->es_lblk;
+			es->es_lblk = end + 1;
+			es->es_len -= delta;
+			if (ext4_es_is_mapped(es->es_status))
+				es->es_pblk += delta;
+			return;
+		} else {
+			ext4_es_erase(inode, es);
+		}
+		es = next;
+	}
+}
+
+static void ext4_es_alloc_spare(struct extent_status **spare, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		spare[i] = kmem_cache_alloc(ext4_es_cachep,
+					    GFP_NOFS | __GFP_NOFAIL);
+}
+
+static void ext4_es_free_spare(struct extent_status **spare, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (spare[i])
+			kmem_cache_free(ext4_es_cachep, spare[i]);
+}
+
+/*
+ * ext4_es_insert_extent() records that [@lblk, @lblk + @len) has
+ * @status, replacing whatever the tree said about the range.  A hole is
+ * only recorded where nothing else is known, so that it never hides a
+ * delayed extent.
+ */
+int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_lblk_t len, ext4_fsblk_t pblk,
+			  unsigned int status)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *spare[2], *es, *new;
+	ext4_lblk_t end;
+
+	len = ext4_es_clamp_len(lblk, len);
+	if (len == 0)
+		return 0;
+	end = lblk + len - 1;
+
+	ext4_es_alloc_spare(spare, 2);
+	write_lock(&ei->i_es_lock);
+	if (status == EXTENT_STATUS_HOLE) {
+		es = __es_tree_search(&ei->i_es_tree.root, lblk);
+		if (es && es->es_lblk <= lblk)
+			goto out;
+		if (es && es->es_lblk <= end)
+			end = es->es_lblk - 1;
+	} else {
+		__es_remove(inode, lblk, end, &spare[1]);
+	}
+
+	new = spare[0];
+	spare[0] = NULL;
+	new->es_lblk = lblk;
+	new->es_len = end - lblk + 1;
+	new->es_pblk = ext4_es_is_mapped(status) ? pblk : 0;
+	new->es_status = status;
+	__es_insert(inode, new);
+out:
+	write_unlock(&ei->i_es_lock);
+	ext4_es_free_spare(spare, 2);
+	return 0;
+}
+
+/*
+ * ext4_es_remove_extent() forgets everything known about
+ * [@lblk, @lblk + @len).
+ */
+void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *spare = NULL;
+
+	len = ext4_es_clamp_len(lblk, len);
+	if (len == 0)
+		return;
+
+	/* Only a range strictly inside one extent needs a new node */
+	ext4_es_alloc_spare(&spare, 1);
+	write_lock(&ei->i_es_lock);
+	__es_remove(inode, lblk, lblk + len - 1, &spare);
+	write_unlock(&ei->i_es_lock);
+	ext4_es_free_spare(&spare, 1);
+}
+
+/*
+ * ext4_es_lookup_extent() copies the extent containing @lblk into @es.
+ * Returns 1 if there is one, 0 if the caller has to look on disk.
+ */
+int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+			  struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es1;
+	int found = 0;
+
+	read_lock(&ei->i_es_lock);
+	es1 = tree->cache_es;
+	if (!es1 || lblk < es1->es_lblk || lblk > ext4_es_end(es1)) {
+		es1 = __es_tree_search(&tree->root, lblk);
+		if (es1 && es1->es_lblk > lblk)
+			es1 = NULL;
+	}
+	if (es1) {
+		tree->cache_es = es1;
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+		es->es_status = es1->es_status;
+		found = 1;
+	}
+	read_unlock(&ei->i_es_lock);
+	return found;
+}
+
+/* Drop everything which can be read back from disk; called under lock */
+static int __es_reclaim(struct inode *inode, int nr_to_scan)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct rb_node *node = rb_first(&tree->root);
+	struct extent_status *es;
+	int nr = 0;
+
+	while (node && nr < nr_to_scan) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		node = rb_next(node);
+		if (ext4_es_is_delayed(es))
+			continue;
+		ext4_es_erase(inode, es);
+		nr++;
+	}
+	return nr;
+}
+
+/*
+ * ext4_es_invalidate() forgets the cached on-disk mapping of @inode,
+ * e.g. after its extents have been swapped with another inode's.
+ */
+void ext4_es_invalidate(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	write_lock(&ei->i_es_lock);
+	__es_reclaim(inode, INT_MAX);
+	write_unlock(&ei->i_es_lock);
+}
+
+/* Called when the inode is evicted */
+void ext4_es_destroy(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct rb_node *node;
+
+	write_lock(&ei->i_es_lock);
+	while ((node = rb_first(&ei->i_es_tree.root)) != NULL)
+		ext4_es_erase(inode, rb_entry(node, struct extent_status,
+					      rb_node));
+	if (!list_empty(&ei->i_es_lru)) {
+		spin_lock(&sbi->s_es_lru_lock);
+		list_del_init(&ei->i_es_lru);
+		spin_unlock(&sbi->s_es_lru_lock);
+	}
+	write_unlock(&ei->i_es_lock);
+}
+
+static int ext4_es_shrink(struct shrinker *shrink, int nr_to_scan,
+			  gfp_t gfp_mask)
+{
+	struct ext4_sb_info *sbi = container_of(shrink, struct ext4_sb_info,
+						s_es_shrinker);
+	struct ext4_inode_info *ei, *tmp;
+	LIST_HEAD(scanned);
+
+	if (nr_to_scan) {
+		spin_lock(&sbi->s_es_lru_lock);
+		list_for_each_entry_safe(ei, tmp, &sbi->s_es_lru, i_es_lru) {
+			if (nr_to_scan <= 0)
+				break;
+			/* i_es_lock nests outside s_es_lru_lock */
+			if (!write_trylock(&ei->i_es_lock))
+				continue;
+			nr_to_scan -= __es_reclaim(&ei->vfs_inode, nr_to_scan);
+			if (ei->i_es_lru_nr)
+				list_move_tail(&ei->i_es_lru, &scanned);
+			else
+				list_del_init(&ei->i_es_lru);
+			write_unlock(&ei->i_es_lock);
+		}
+		list_splice_tail(&scanned, &sbi->s_es_lru);
+		spin_unlock(&sbi->s_es_lru_lock);
+	}
+	return percpu_counter_read_positive(&sbi->s_extent_cache_cnt);
+}
+
+void ext4_es_register_shrinker(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	INIT_LIST_HEAD(&sbi->s_es_lru);
+	spin_lock_init(&sbi->s_es_lru_lock);
+	sbi->s_es_shrinker.shrink = ext4_es_shrink;
+	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sbi->s_es_shrinker);
+}
+
+void ext4_es_unregister_shrinker(struct super_block *sb)
+{
+	unregister_shrinker(&EXT4_SB(sb)->s_es_shrinker);
+}
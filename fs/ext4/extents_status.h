@@ -0,0 +1,70 @@
+/*
+ *  fs/ext4/extents_status.h
+ *
+ * In-memory tree of the mapping state of an inode's logical blocks.
+ *
+ * Written, unwritten and hole extents are a cache of the on-disk extent
+ * tree and may be reclaimed at any time.  Delayed extents exist only in
+ * memory, describe blocks reserved by delayed allocation, and stay until
+ * the blocks are allocated or their pages are dropped.
+ */
+
+#ifndef _EXT4_EXTENTS_STATUS_H
+#define _EXT4_EXTENTS_STATUS_H
+
+#define EXTENT_STATUS_WRITTEN	0x01	/* written extent */
+#define EXTENT_STATUS_UNWRITTEN	0x02	/* unwritten extent */
+#define EXTENT_STATUS_DELAYED	0x04	/* delayed extent */
+#define EXTENT_STATUS_HOLE	0x08	/* hole */
+
+struct extent_status {
+	struct rb_node rb_node;
+	ext4_lblk_t es_lblk;	/* first logical block extent covers */
+	ext4_lblk_t es_len;	/* length of extent in block */
+	ext4_fsblk_t es_pblk;	/* first physical block, if mapped */
+	unsigned int es_status;	/* EXTENT_STATUS_* */
+};
+
+struct ext4_es_tree {
+	struct rb_root root;
+	struct extent_status *cache_es;	/* recently accessed extent */
+};
+
+static inline int ext4_es_is_written(struct extent_status *es)
+{
+	return es->es_status == EXTENT_STATUS_WRITTEN;
+}
+
+static inline int ext4_es_is_unwritten(struct extent_status *es)
+{
+	return es->es_status == EXTENT_STATUS_UNWRITTEN;
+}
+
+static inline int ext4_es_is_delayed(struct extent_status *es)
+{
+	return es->es_status == EXTENT_STATUS_DELAYED;
+}
+
+static inline int ext4_es_is_hole(struct extent_status *es)
+{
+	return es->es_status == EXTENT_STATUS_HOLE;
+}
+
+extern int __init ext4_init_es(void);
+extern void ext4_exit_es(void);
+extern void ext4_es_init_tree(struct ext4_es_tree *tree);
+
+extern int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+				 ext4_lblk_t len, ext4_fsblk_t pblk,
+				 unsigned int status);
+extern void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+				  ext4_lblk_t len);
+extern int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+				 struct extent_status *es);
+extern void ext4_es_invalidate(struct inode *inode);
+extern void ext4_es_destroy(struct inode *inode);
+
+extern void ext4_es_register_shrinker(struct super_block *sb);
+extern void ext4_es_unregister_shrinker(struct super_block *sb);
+
+#endif /* _EXT4_EXTENTS_STATUS_H */
@@ -0,0 +1,253 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits: let fsync persist an inode whose change in the running
+ * transaction is limited to its size and timestamps by writing a single
+ * block to the journal's fast commit area, instead of committing the
+ * whole running transaction.
+ *
+ * The common cases are fsync after overwriting data in place (only the
+ * times change) and after extending a file into blocks it already owns.
+ * Anything which touches other metadata - block or inode allocation,
+ * directory entries, xattrs, the orphan list - marks the inode ineligible
+ * for the rest of the transaction, and fsync falls back to a full commit.
+ * As a second line of defence, the on-disk inode minus size and times is
+ * checksummed the first time it is dirtied in a transaction and compared
+ * again at fsync time.
+ *
+ * Replay after a crash only ever grows i_size and moves timestamps
+ * forward, so applying a stale record is harmless.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/crc32.h>
+#include <linux/blkdev.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+/* On-disk record, one per fast commit block */
+struct ext4_fc_inode {
+	__le32	fc_ino;
+	__le32	fc_generation;
+	__le64	fc_size;
+	__le64	fc_atime;
+	__le64	fc_ctime;
+	__le64	fc_mtime;
+	__le32	fc_atime_nsec;
+	__le32	fc_ctime_nsec;
+	__le32	fc_mtime_nsec;
+	__le32	fc_reserved;
+};
+
+#define EXT4_FC_CSUM_RANGE(crc, raw, from, to)				\
+	crc32_le((crc), (u8 *)(raw) + offsetof(struct ext4_inode, from), \
+		 offsetof(struct ext4_inode, to) -			\
+		 offsetof(struct ext4_inode, from))
+
+/*
+ * Checksum everything in the on-disk inode except the fields a fast
+ * commit is allowed to change: size, times and i_version.
+ */
+static u32 ext4_fc_inode_csum(struct inode *inode, struct ext4_inode *raw)
+{
+	u32 crc;
+
+	crc = EXT4_FC_CSUM_RANGE(~0, raw, i_mode, i_size_lo);
+	crc = EXT4_FC_CSUM_RANGE(crc, raw, i_dtime, osd1);
+	crc = EXT4_FC_CSUM_RANGE(crc, raw, i_block, i_size_high);
+	crc = EXT4_FC_CSUM_RANGE(crc, raw, i_obso_faddr, i_extra_isize);
+	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE) {
+		crc = EXT4_FC_CSUM_RANGE(crc, raw, i_extra_isize,
+					 i_ctime_extra);
+		if (EXT4_FITS_IN_INODE(raw, EXT4_I(inode), i_crtime_extra))
+			crc = EXT4_FC_CSUM_RANGE(crc, raw, i_crtime,
+						 i_version_hi);
+	}
+	return crc;
+}
+
+/*
+ * Called from ext4_mark_iloc_dirty() before the in-core inode is copied
+ * into @raw: the first time an inode is dirtied in a transaction, @raw
+ * still holds its state as of the previous one.
+ */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode,
+			 struct ext4_inode *raw)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	tid_t tid;
+
+	if (!test_opt2(inode->i_sb, JOURNAL_FAST_COMMIT) ||
+	    !ext4_handle_valid(handle))
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	spin_lock(&ei->i_fc_lock);
+	if (!ext4_test_inode_state(inode, EXT4_STATE_FC_BASE) ||
+	    ei->i_fc_base_tid != tid) {
+		ei->i_fc_base_tid = tid;
+		ei->i_fc_base_csum = ext4_fc_inode_csum(inode, raw);
+		ext4_set_inode_state(inode, EXT4_STATE_FC_BASE);
+	}
+	spin_unlock(&ei->i_fc_lock);
+}
+
+static int ext4_fc_eligible(struct inode *inode, tid_t commit_tid)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int ret;
+
+	spin_lock(&ei->i_fc_lock);
+	ret = ext4_test_inode_state(inode, EXT4_STATE_FC_BASE) &&
+		ei->i_fc_base_tid == commit_tid &&
+		ei->i_fc_ineligible_tid != commit_tid;
+	spin_unlock(&ei->i_fc_lock);
+	return ret;
+}
+
+/*
+ * Try to make the changes to @inode in transaction @commit_tid durable
+ * with a fast commit.  Returns 0 on success; on any error the caller
+ * must commit the transaction as usual.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	struct ext4_fc_inode fc;
+	struct ext4_iloc iloc;
+	tid_t running = 0;
+	u32 csum;
+	int err;
+
+	if (!test_opt2(inode->i_sb, JOURNAL_FAST_COMMIT))
+		return -EOPNOTSUPP;
+
+	/* Only the running transaction can be short-cut */
+	read_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction)
+		running = journal->j_running_transaction->t_tid;
+	read_unlock(&journal->j_state_lock);
+	if (!running || running != commit_tid)
+		return -EAGAIN;
+
+	if (!ext4_fc_eligible(inode, commit_tid))
+		return -EAGAIN;
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		return err;
+	csum = ext4_fc_inode_csum(inode, ext4_raw_inode(&iloc));
+	brelse(iloc.bh);
+	if (csum != EXT4_I(inode)->i_fc_base_csum)
+		return -EAGAIN;
+
+	memset(&fc, 0, sizeof(fc));
+	fc.fc_ino = cpu_to_le32(inode->i_ino);
+	fc.fc_generation = cpu_to_le32(inode->i_generation);
+	fc.fc_size = cpu_to_le64(EXT4_I(inode)->i_disksize);
+	fc.fc_atime = cpu_to_le64(inode->i_atime.tv_sec);
+	fc.fc_ctime = cpu_to_le64(inode->i_ctime.tv_sec);
+	fc.fc_mtime = cpu_to_le64(inode->i_mtime.tv_sec);
+	fc.fc_atime_nsec = cpu_to_le32(inode->i_atime.tv_nsec);
+	fc.fc_ctime_nsec = cpu_to_le32(inode->i_ctime.tv_nsec);
+	fc.fc_mtime_nsec = cpu_to_le32(inode->i_mtime.tv_nsec);
+
+	/* Lost a race with a change we cannot describe */
+	if (!ext4_fc_eligible(inode, commit_tid))
+		return -EAGAIN;
+
+	err = jbd2_fc_commit(journal, &fc, sizeof(fc));
+	if (err)
+		return err;
+
+	/*
+	 * The fast commit block went to the journal device; the data the
+	 * caller wrote back may still be in the cache of the fs device.
+	 */
+	if (journal->j_fs_dev != journal->j_dev &&
+	    (journal->j_flags & JBD2_BARRIER))
+		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	return 0;
+}
+
+static void ext4_fc_replay_time(struct timespec *ts, __le64 sec, __le32 nsec)
+{
+	struct timespec t = {
+		.tv_sec = le64_to_cpu(sec),
+		.tv_nsec = le32_to_cpu(nsec),
+	};
+
+	if (timespec_compare(&t, ts) > 0)
+		*ts = t;
+}
+
+static int ext4_fc_replay_one(journal_t *journal, const void *data, int len,
+			      void *priv)
+{
+	struct super_block *sb = priv;
+	const struct ext4_fc_inode *fc = data;
+	struct inode *inode;
+	handle_t *handle;
+	loff_t size;
+	int err;
+
+	if (len != sizeof(*fc))
+		return -EINVAL;
+
+	inode = ext4_iget(sb, le32_to_cpu(fc->fc_ino));
+	if (IS_ERR(inode))
+		return 0;
+	if (inode->i_generation != le32_to_cpu(fc->fc_generation) ||
+	    !inode->i_nlink || !S_ISREG(inode->i_mode)) {
+		iput(inode);
+		return 0;
+	}
+
+	handle = ext4_journal_start(inode, 2);
+	if (IS_ERR(handle)) {
+		iput(inode);
+		return PTR_ERR(handle);
+	}
+	size = le64_to_cpu(fc->fc_size);
+	if (size > inode->i_size) {
+		i_size_write(inode, size);
+		EXT4_I(inode)->i_disksize = size;
+	}
+	ext4_fc_replay_time(&inode->i_atime, fc->fc_atime, fc->fc_atime_nsec);
+	ext4_fc_replay_time(&inode->i_ctime, fc->fc_ctime, fc->fc_ctime_nsec);
+	ext4_fc_replay_time(&inode->i_mtime, fc->fc_mtime, fc->fc_mtime_nsec);
+	err = ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+	jbd_debug(2, "fast commit replayed inode %lu, size %lld\n",
+		  inode->i_ino, inode->i_size);
+	iput(inode);
+	return err;
+}
+
+/*
+ * Apply fast commit records left behind by a crash.  Called at mount
+ * time once the journal has been recovered and orphans cleaned up.
+ */
+void ext4_fc_replay(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned int s_flags = sb->s_flags;
+	int err;
+
+	if (!journal || !(journal->j_flags & JBD2_FC_REPLAY))
+		return;
+
+	if (bdev_read_only(sb->s_bdev)) {
+		ext4_msg(sb, KERN_ERR, "write access "
+			"unavailable, skipping fast commit replay");
+		return;
+	}
+
+	if (s_flags & MS_RDONLY)
+		sb->s_flags &= ~MS_RDONLY;
+	err = jbd2_fc_replay(journal, ext4_fc_replay_one, sb);
+	if (err)
+		ext4_msg(sb, KERN_ERR, "fast commit replay failed: %d", err);
+	sb->s_flags = s_flags; /* Restore MS_RDONLY status */
+}
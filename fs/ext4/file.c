@@ -28,6 +28,7 @@
 #include "ext4_jbd2.h"
 #include "xattr.h"
 #include "acl.h"
+#include "ext4_extents.h"
 
 /*
  * Called when an inode is released. Note that this is different
@@ -210,6 +211,80 @@ static int ext4_file_open(struct inode * inode, struct file * filp)
 	return dquot_file_open(inode, filp);
 }
 
+/*
+ * Find the first block at or after @lblk which is data (written,
+ * unwritten or delayed), or is not, and return its length in @len.
+ */
+static int ext4_block_is_data(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t end, ext4_lblk_t *len)
+{
+	struct ext4_map_blocks map;
+	struct extent_status es;
+	int ret;
+
+	if (ext4_es_lookup_extent(inode, lblk, &es))
+		goto found;
+
+	map.m_lblk = lblk;
+	map.m_len = min_t(ext4_lblk_t, end - lblk + 1, EXT_INIT_MAX_LEN);
+	ret = ext4_map_blocks(NULL, inode, &map, 0);
+	if (ret < 0)
+		return ret;
+	if (ret > 0) {
+		*len = ret;
+		return 1;
+	}
+
+	/* The hole went into the tree, unless the old one-extent cache hit */
+	if (ext4_es_lookup_extent(inode, lblk, &es))
+		goto found;
+	ext4_ext_invalidate_cache(inode);
+	ret = ext4_map_blocks(NULL, inode, &map, 0);
+	if (ret < 0)
+		return ret;
+	if (ret == 0 && ext4_es_lookup_extent(inode, lblk, &es))
+		goto found;
+	*len = ret > 0 ? ret : 1;
+	return ret > 0;
+
+found:
+	*len = es.es_lblk + es.es_len - lblk;
+	return !ext4_es_is_hole(&es);
+}
+
+/*
+ * SEEK_DATA and SEEK_HOLE for extent mapped files.  Unwritten extents
+ * count as data: they may have dirty pages in the page cache.
+ */
+static loff_t ext4_seek_data_hole(struct inode *inode, loff_t offset,
+				  int origin)
+{
+	unsigned int blkbits = inode->i_blkbits;
+	loff_t isize = i_size_read(inode);
+	ext4_lblk_t lblk, end, len;
+	int ret;
+
+	if (offset < 0 || offset >= isize)
+		return -ENXIO;
+
+	lblk = offset >> blkbits;
+	end = (isize - 1) >> blkbits;
+	while (lblk <= end) {
+		ret = ext4_block_is_data(inode, lblk, end, &len);
+		if (ret < 0)
+			return ret;
+		if (ret == (origin == SEEK_DATA)) {
+			if (((loff_t)lblk << blkbits) > offset)
+				offset = (loff_t)lblk << blkbits;
+			return offset < isize ? offset : isize;
+		}
+		if (len > end - lblk)
+			break;
+		lblk += len;
+	}
+	return origin == SEEK_DATA ? -ENXIO : isize;
+}
+
 /*
  * ext4_llseek() copied from generic_file_llseek() to handle both
  * block-mapped and extent-mapped maxbytes values. This should
@@ -236,6 +311,22 @@ loff_t ext4_llseek(struct file *file, loff_t offset, int origin)
 		}
 		offset += file->f_pos;
 		break;
+	case SEEK_DATA:
+	case SEEK_HOLE:
+		if (S_ISREG(inode->i_mode) &&
+		    ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+			offset = ext4_seek_data_hole(inode, offset, origin);
+		} else if (offset >= inode->i_size) {
+			/* Block mapped files are all data */
+			offset = -ENXIO;
+		} else if (origin == SEEK_HOLE) {
+			offset = inode->i_size;
+		}
+		if (offset < 0) {
+			mutex_unlock(&inode->i_mutex);
+			return offset;
+		}
+		break;
 	}
 
 	if (offset < 0 || offset > maxbytes) {
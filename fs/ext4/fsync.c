@@ -172,6 +172,7 @@ int ext4_sync_file(struct file *file, int datasync)
 	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
 	int ret;
 	tid_t commit_tid;
+	ktime_t start = ktime_get();
 
 	J_ASSERT(ext4_journal_current_handle() == NULL);
 
@@ -211,6 +212,8 @@ int ext4_sync_file(struct file *file, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	if (!ext4_fc_commit(inode, commit_tid))
+		goto out;
 	if (jbd2_log_start_commit(journal, commit_tid)) {
 		/*
 		 * When the journal is on a different device than the
@@ -229,6 +232,8 @@ int ext4_sync_file(struct file *file, int datasync)
 	} else if (journal->j_flags & JBD2_BARRIER)
 		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
  out:
+	if (journal)
+		jbd2_journal_account_fsync(journal, start);
 	trace_ext4_sync_file_exit(inode, ret);
 	return ret;
 }
@@ -832,6 +832,7 @@ struct inode *ext4_new_inode(handle_t *handle, struct inode *dir, int mode,
 		return ERR_PTR(-ENOMEM);
 	ei = EXT4_I(inode);
 	sbi = EXT4_SB(sb);
+	ext4_fc_mark_ineligible(handle, inode);
 
 	if (!goal)
 		goal = sbi->s_inode_goal;
@@ -1276,12 +1276,41 @@ static pgoff_t ext4_num_dirty_pages(struct inode *inode, pgoff_t idx,
 int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		    struct ext4_map_blocks *map, int flags)
 {
+	struct extent_status es;
 	int retval;
 
 	map->m_flags = 0;
 	ext_debug("ext4_map_blocks(): inode %lu, flag %d, max_blocks %u,"
 		  "logical block %lu\n", inode->i_ino, flags, map->m_len,
 		  (unsigned long) map->m_lblk);
+
+	/*
+	 * The extent status tree answers most lookups without i_data_sem.
+	 * Anything but a written extent still has to go through the slow
+	 * path when the caller wants blocks allocated.
+	 */
+	if (ext4_es_lookup_extent(inode, map->m_lblk, &es)) {
+		if (ext4_es_is_written(&es) || ext4_es_is_unwritten(&es)) {
+			if (!ext4_es_is_written(&es) &&
+			    (flags & EXT4_GET_BLOCKS_CREATE))
+				goto slow;
+			map->m_pblk = es.es_pblk + map->m_lblk - es.es_lblk;
+			map->m_len = min_t(unsigned int, map->m_len,
+					   es.es_lblk + es.es_len - map->m_lblk);
+			map->m_flags = ext4_es_is_written(&es) ?
+				EXT4_MAP_MAPPED : EXT4_MAP_UNWRITTEN;
+			retval = map->m_len;
+			if (map->m_flags & EXT4_MAP_MAPPED) {
+				int ret = check_block_validity(inode, map);
+				if (ret != 0)
+					return ret;
+			}
+			return retval;
+		}
+		if ((flags & EXT4_GET_BLOCKS_CREATE) == 0)
+			return 0;
+	}
+slow:
 	/*
 	 * Try to see if we can get the block without requesting a new
 	 * file system block.
@@ -1373,6 +1402,14 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 	if (flags & EXT4_GET_BLOCKS_DELALLOC_RESERVE)
 		ext4_clear_inode_state(inode, EXT4_STATE_DELALLOC_RESERVED);
 
+	/*
+	 * The mapping of these blocks changed; the next lookup rereads it
+	 * from disk.  Callers hold the page lock or i_mutex, so nobody
+	 * relies on the stale status in the meantime.
+	 */
+	if (retval > 0)
+		ext4_es_remove_extent(inode, map->m_lblk, retval);
+
 	up_write((&EXT4_I(inode)->i_data_sem));
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, map);
@@ -1999,19 +2036,27 @@ static void ext4_da_page_release_reservation(struct page *page,
 	int to_release = 0;
 	struct buffer_head *head, *bh;
 	unsigned int curr_off = 0;
+	struct inode *inode = page->mapping->host;
+	ext4_lblk_t lblk, first = 0;
 
 	head = page_buffers(page);
 	bh = head;
+	lblk = page->index << (PAGE_CACHE_SHIFT - inode->i_blkbits);
 	do {
 		unsigned int next_off = curr_off + bh->b_size;
 
 		if ((offset <= curr_off) && (buffer_delay(bh))) {
+			if (!to_release)
+				first = lblk;
 			to_release++;
 			clear_buffer_delay(bh);
 		}
 		curr_off = next_off;
+		lblk++;
 	} while ((bh = bh->b_this_page) != head);
-	ext4_da_release_space(page->mapping->host, to_release);
+	if (to_release)
+		ext4_es_remove_extent(inode, first, lblk - first);
+	ext4_da_release_space(inode, to_release);
 }
 
 /*
@@ -2489,6 +2534,8 @@ static int ext4_da_get_block_prep(struct inode *inode, sector_t iblock,
 		if (ret)
 			/* not enough space to reserve */
 			return ret;
+		ext4_es_insert_extent(inode, iblock, 1, 0,
+				      EXTENT_STATUS_DELAYED);
 
 		map_bh(bh, inode->i_sb, invalid_block);
 		set_buffer_new(bh);
@@ -5542,6 +5589,8 @@ int ext4_mark_iloc_dirty(handle_t *handle,
 	if (test_opt(inode->i_sb, I_VERSION))
 		inode_inc_iversion(inode);
 
+	ext4_fc_track_inode(handle, inode, ext4_raw_inode(iloc));
+
 	/* the do_update_inode consumes one bh->b_count */
 	get_bh(iloc->bh);
 
@@ -331,6 +331,34 @@ mext_out:
 		return err;
 	}
 
+	case EXT4_IOC_FC_AREA:
+	{
+		journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+		__u32 nblocks;
+		int err;
+
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		if (!journal)
+			return -EINVAL;
+		if (get_user(nblocks, (__u32 __user *)arg))
+			return -EFAULT;
+		if (!nblocks)
+			nblocks = EXT4_DEF_FC_BLOCKS;
+
+		err = mnt_want_write(filp->f_path.mnt);
+		if (err)
+			return err;
+		/* The area can only be carved off an empty log */
+		jbd2_journal_lock_updates(journal);
+		err = jbd2_journal_flush(journal);
+		if (!err)
+			err = jbd2_fc_init(journal, nblocks);
+		jbd2_journal_unlock_updates(journal);
+		mnt_drop_write(filp->f_path.mnt);
+		return err;
+	}
+
 	case FITRIM:
 	{
 		struct super_block *sb = inode->i_sb;
@@ -427,6 +455,7 @@ long ext4_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return err;
 	}
 	case EXT4_IOC_MOVE_EXT:
+	case EXT4_IOC_FC_AREA:
 	case FITRIM:
 		break;
 	default:
@@ -91,6 +91,14 @@
  * The reason for having a per cpu locality group is to reduce the contention
  * between CPUs. It is possible to get scheduled at this point.
  *
+ * Each locality group remembers the prealloc space it last carved from in
+ * lg_cur_pa, and small requests are served from it without walking the
+ * lists.  New group prealloc spaces are looked for starting at
+ * lg_goal_group, which starts out as the cpu number and, when that group
+ * can no longer satisfy a refill, hops forward by nr_cpu_ids.  Different
+ * CPUs thus carve their reserved extents from different block groups and
+ * do not contend on the group lock and bitmap when marking blocks used.
+ *
  * The locality group prealloc space is used looking at whether we have
  * enough free space (pa_free) within the prealloc space.
  *
@@ -2545,6 +2553,8 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		for (j = 0; j < PREALLOC_TB_SIZE; j++)
 			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
 		spin_lock_init(&lg->lg_prealloc_lock);
+		RCU_INIT_POINTER(lg->lg_cur_pa, NULL);
+		lg->lg_goal_group = i;
 	}
 
 	if (sbi->s_proc)
@@ -2629,9 +2639,11 @@ int ext4_mb_release(struct super_block *sb)
 				sbi->s_mb_buddies_generated++,
 				sbi->s_mb_generation_time);
 		printk(KERN_INFO
-		       "EXT4-fs: mballoc: %u preallocated, %u discarded\n",
+		       "EXT4-fs: mballoc: %u preallocated, %u discarded, "
+				"%u reserved extent hits\n",
 				atomic_read(&sbi->s_mb_preallocated),
-				atomic_read(&sbi->s_mb_discarded));
+				atomic_read(&sbi->s_mb_discarded),
+				atomic_read(&sbi->s_bal_lg_fast));
 	}
 
 	free_percpu(sbi->s_locality_groups);
@@ -2906,12 +2918,20 @@ static void ext4_mb_normalize_group_request(struct ext4_allocation_context *ac)
 {
 	struct super_block *sb = ac->ac_sb;
 	struct ext4_locality_group *lg = ac->ac_lg;
+	ext4_group_t group;
 
 	BUG_ON(lg == NULL);
 	if (EXT4_SB(sb)->s_stripe)
 		ac->ac_g_ex.fe_len = EXT4_SB(sb)->s_stripe;
 	else
 		ac->ac_g_ex.fe_len = EXT4_SB(sb)->s_mb_group_prealloc;
+
+	/* look for the new reserved extent in this cpu's own group */
+	group = lg->lg_goal_group % ext4_get_groups_count(sb);
+	if (group != ac->ac_g_ex.fe_group) {
+		ac->ac_g_ex.fe_group = group;
+		ac->ac_g_ex.fe_start = 0;
+	}
 	mb_debug(1, "#%u: goal %u blocks for locality group\n",
 		current->pid, ac->ac_g_ex.fe_len);
 }
@@ -3277,6 +3297,27 @@ ext4_mb_use_preallocated(struct ext4_allocation_context *ac)
 	lg = ac->ac_lg;
 	if (lg == NULL)
 		return 0;
+
+	/* the reserved extent of this cpu serves most small requests */
+	rcu_read_lock();
+	pa = rcu_dereference(lg->lg_cur_pa);
+	if (pa) {
+		spin_lock(&pa->pa_lock);
+		if (pa->pa_deleted == 0 &&
+				pa->pa_free >= ac->ac_o_ex.fe_len) {
+			atomic_inc(&pa->pa_count);
+			spin_unlock(&pa->pa_lock);
+			rcu_read_unlock();
+			ext4_mb_use_group_pa(ac, pa);
+			ac->ac_criteria = 20;
+			if (EXT4_SB(ac->ac_sb)->s_mb_stats)
+				atomic_inc(&EXT4_SB(ac->ac_sb)->s_bal_lg_fast);
+			return 1;
+		}
+		spin_unlock(&pa->pa_lock);
+	}
+	rcu_read_unlock();
+
 	order  = fls(ac->ac_o_ex.fe_len) - 1;
 	if (order > PREALLOC_TB_SIZE - 1)
 		/* The max size of hash table is PREALLOC_TB_SIZE */
@@ -3384,6 +3425,22 @@ static void ext4_mb_pa_callback(struct rcu_head *head)
 	kmem_cache_free(ext4_pspace_cachep, pa);
 }
 
+/*
+ * free a pa marked deleted once RCU readers are done with it; a group pa
+ * may still be the reserved extent of its locality group
+ */
+static void ext4_mb_free_pa(struct ext4_prealloc_space *pa)
+{
+	struct ext4_locality_group *lg;
+
+	if (pa->pa_type == MB_GROUP_PA) {
+		lg = container_of(pa->pa_obj_lock, struct ext4_locality_group,
+				  lg_prealloc_lock);
+		cmpxchg(&lg->lg_cur_pa, pa, NULL);
+	}
+	call_rcu(&(pa)->u.pa_rcu, ext4_mb_pa_callback);
+}
+
 /*
  * drops a reference to preallocated space descriptor
  * if this was the last reference and the space is consumed
@@ -3439,7 +3496,7 @@ static void ext4_mb_put_pa(struct ext4_allocation_context *ac,
 	list_del_rcu(&pa->pa_inode_list);
 	spin_unlock(pa->pa_obj_lock);
 
-	call_rcu(&(pa)->u.pa_rcu, ext4_mb_pa_callback);
+	ext4_mb_free_pa(pa);
 }
 
 /*
@@ -3580,6 +3637,15 @@ ext4_mb_new_group_pa(struct ext4_allocation_context *ac)
 	lg = ac->ac_lg;
 	BUG_ON(lg == NULL);
 
+	/*
+	 * the goal group could not hold a whole reserved extent: move this
+	 * cpu on to the next group of its own rather than following the
+	 * allocator into a group another cpu carves from
+	 */
+	if (ac->ac_b_ex.fe_group != ac->ac_g_ex.fe_group)
+		lg->lg_goal_group = (ac->ac_g_ex.fe_group + nr_cpu_ids) %
+				    ext4_get_groups_count(sb);
+
 	pa->pa_obj_lock = &lg->lg_prealloc_lock;
 	pa->pa_inode = NULL;
 
@@ -3788,7 +3854,7 @@ repeat:
 			ext4_mb_release_inode_pa(&e4b, bitmap_bh, pa);
 
 		list_del(&pa->u.pa_tmp_list);
-		call_rcu(&(pa)->u.pa_rcu, ext4_mb_pa_callback);
+		ext4_mb_free_pa(pa);
 	}
 
 out:
@@ -3904,7 +3970,7 @@ repeat:
 		put_bh(bitmap_bh);
 
 		list_del(&pa->u.pa_tmp_list);
-		call_rcu(&(pa)->u.pa_rcu, ext4_mb_pa_callback);
+		ext4_mb_free_pa(pa);
 	}
 }
 
@@ -4151,7 +4217,7 @@ ext4_mb_discard_lg_preallocations(struct super_block *sb,
 
 		ext4_mb_unload_buddy(&e4b);
 		list_del(&pa->u.pa_tmp_list);
-		call_rcu(&(pa)->u.pa_rcu, ext4_mb_pa_callback);
+		ext4_mb_free_pa(pa);
 	}
 }
 
@@ -4225,6 +4291,9 @@ static int ext4_mb_release_context(struct ext4_allocation_context *ac)
 			pa->pa_lstart += ac->ac_b_ex.fe_len;
 			pa->pa_free -= ac->ac_b_ex.fe_len;
 			pa->pa_len -= ac->ac_b_ex.fe_len;
+			/* keep carving from it while it lasts */
+			if (pa->pa_deleted == 0 && pa->pa_free)
+				rcu_assign_pointer(ac->ac_lg->lg_cur_pa, pa);
 			spin_unlock(&pa->pa_lock);
 		}
 	}
@@ -4292,6 +4361,7 @@ ext4_fsblk_t ext4_mb_new_blocks(handle_t *handle,
 	sbi = EXT4_SB(sb);
 
 	trace_ext4_request_blocks(ar);
+	ext4_fc_mark_ineligible(handle, ar->inode);
 
 	/*
 	 * For delayed allocation, we could skip the ENOSPC and
@@ -4528,6 +4598,7 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 	int err = 0;
 	int ret;
 
+	ext4_fc_mark_ineligible(handle, inode);
 	if (bh) {
 		if (block)
 			BUG_ON(block != bh->b_blocknr);
@@ -160,6 +160,14 @@ struct ext4_locality_group {
 	/* list of preallocations */
 	struct list_head	lg_prealloc_list[PREALLOC_TB_SIZE];
 	spinlock_t		lg_prealloc_lock;
+	/*
+	 * Reserved extent small requests on this cpu are carved from
+	 * first, without walking the lists.  Set under lg_mutex, cleared
+	 * by whoever frees the pa.
+	 */
+	struct ext4_prealloc_space __rcu *lg_cur_pa;
+	/* group the next reserved extent is looked for in [lg_mutex] */
+	ext4_group_t		lg_goal_group;
 };
 
 struct ext4_allocation_context {
@@ -378,6 +378,7 @@ static int ext4_ext_swap_inode_data(handle_t *handle, struct inode *inode,
 	 */
 	ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS);
 	memcpy(ei->i_data, tmp_ei->i_data, sizeof(ei->i_data));
+	ext4_es_invalidate(inode);
 
 	/*
 	 * Update i_blocks with the new blocks that got
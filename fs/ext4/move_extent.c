@@ -764,6 +764,8 @@ out:
 
 	ext4_ext_invalidate_cache(orig_inode);
 	ext4_ext_invalidate_cache(donor_inode);
+	ext4_es_invalidate(orig_inode);
+	ext4_es_invalidate(donor_inode);
 
 	double_up_write_data_sem(orig_inode, donor_inode);
 
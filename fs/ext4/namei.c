@@ -1973,6 +1973,7 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	if (!ext4_handle_valid(handle))
 		return 0;
 
+	ext4_fc_mark_ineligible(handle, inode);
 	mutex_lock(&EXT4_SB(sb)->s_orphan_lock);
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		goto out_unlock;
@@ -2055,6 +2056,8 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	if (handle && !ext4_handle_valid(handle))
 		return 0;
 
+	if (handle)
+		ext4_fc_mark_ineligible(handle, inode);
 	mutex_lock(&EXT4_SB(inode->i_sb)->s_orphan_lock);
 	if (list_empty(&ei->i_orphan))
 		goto out;
@@ -2379,6 +2382,8 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	retval = -ENOENT;
 	if (!old_bh || le32_to_cpu(old_de->inode) != old_inode->i_ino)
 		goto end_rename;
+	/* Only ctime changes, but fsync must still persist the new name */
+	ext4_fc_mark_ineligible(handle, old_inode);
 
 	new_inode = new_dentry->d_inode;
 	new_bh = ext4_find_entry(new_dir, &new_dentry->d_name, &new_de);
@@ -981,6 +981,7 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 		return -EINVAL;
 	if (strlen(name) > 255)
 		return -ERANGE;
+	ext4_fc_mark_ineligible(handle, inode);
 	down_write(&EXT4_I(inode)->xattr_sem);
 	no_expand = ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND);
 	ext4_set_inode_state(inode, EXT4_STATE_NO_EXPAND);
@@ -1147,6 +1148,7 @@ int ext4_expand_extra_isize_ea(struct inode *inode, int new_extra_isize,
 	int extra_isize = 0, error = 0, tried_min_extra_isize = 0;
 	int s_min_extra_isize = le16_to_cpu(EXT4_SB(inode->i_sb)->s_es->s_min_extra_isize);
 
+	ext4_fc_mark_ineligible(handle, inode);
 	down_write(&EXT4_I(inode)->xattr_sem);
 retry:
 	if (EXT4_I(inode)->i_extra_isize >= new_extra_isize) {
@@ -39,7 +39,10 @@ struct wb_writeback_work {
 	unsigned int for_kupdate:1;
 	unsigned int range_cyclic:1;
 	unsigned int for_background:1;
+	unsigned int preempted:1;	/* yielded to higher class work */
 
+	enum wb_class wb_class;
+	unsigned long queued;		/* jiffies when first queued */
 	struct list_head list;		/* pending work list */
 	struct completion *done;	/* set if the caller waits */
 };
@@ -98,13 +101,30 @@ static void bdi_wakeup_flusher(struct backing_dev_info *bdi)
 	}
 }
 
+/*
+ * A WB_SYNC_NONE work that somebody waits on, like the first pass of
+ * sync_filesystem(), has a task blocked on it just like WB_SYNC_ALL work
+ * does, so it must not queue behind the unwaited bdi-wide flushes that
+ * every sync() call adds to the async class.
+ */
+static enum wb_class wb_work_class(struct wb_writeback_work *work)
+{
+	if (work->sync_mode == WB_SYNC_ALL || work->done)
+		return WB_CLASS_SYNC;
+	if (work->for_background || work->for_kupdate)
+		return WB_CLASS_BACKGROUND;
+	return WB_CLASS_ASYNC;
+}
+
 static void bdi_queue_work(struct backing_dev_info *bdi,
 			   struct wb_writeback_work *work)
 {
+	work->wb_class = wb_work_class(work);
+	work->queued = jiffies;
 	trace_writeback_queue(bdi, work);
 
 	spin_lock_bh(&bdi->wb_lock);
-	list_add_tail(&work->list, &bdi->work_list);
+	list_add_tail(&work->list, &bdi->work_list[work->wb_class]);
 	if (!bdi->wb.task)
 		trace_writeback_nothread(bdi, work);
 	bdi_wakeup_flusher(bdi);
@@ -698,13 +718,17 @@ static long wb_writeback(struct bdi_writeback *wb,
 
 		/*
 		 * Background writeout and kupdate-style writeback may
-		 * run forever. Stop them if there is other work to do
-		 * so that e.g. sync can proceed. They'll be restarted
-		 * after the other works are all done.
+		 * run forever, and a large WB_SYNC_NONE request may run
+		 * for a long time. Stop them if there is higher class
+		 * work to do so that e.g. sync can proceed. Background
+		 * work is restarted after the queued works are done,
+		 * preempted queued work is requeued by wb_do_writeback().
 		 */
-		if ((work->for_background || work->for_kupdate) &&
-		    !list_empty(&wb->bdi->work_list))
+		if (work->sync_mode == WB_SYNC_NONE &&
+		    bdi_has_work_above(wb->bdi, work->wb_class)) {
+			work->preempted = 1;
 			break;
+		}
 
 		/*
 		 * For background writeout, stop when we are below the
@@ -724,6 +748,9 @@ static long wb_writeback(struct bdi_writeback *wb,
 			writeback_inodes_wb(wb, &wbc);
 		trace_wbc_writeback_written(&wbc, wb->bdi);
 
+		/* keep the bandwidth estimate fresh for balance_dirty_pages() */
+		bdi_update_bandwidth(wb->bdi, 0, 0, 0, 0, 0, wbc.wb_start);
+
 		work->nr_pages -= write_chunk - wbc.nr_to_write;
 		wrote += write_chunk - wbc.nr_to_write;
 
@@ -762,23 +789,64 @@ static long wb_writeback(struct bdi_writeback *wb,
 }
 
 /*
- * Return the next wb_writeback_work struct that hasn't been processed yet.
+ * Return the next wb_writeback_work struct that hasn't been processed yet,
+ * taking it from the highest priority class that has any.
  */
 static struct wb_writeback_work *
 get_next_work_item(struct backing_dev_info *bdi)
 {
 	struct wb_writeback_work *work = NULL;
+	int i;
 
 	spin_lock_bh(&bdi->wb_lock);
-	if (!list_empty(&bdi->work_list)) {
-		work = list_entry(bdi->work_list.next,
-				  struct wb_writeback_work, list);
-		list_del_init(&work->list);
+	for (i = 0; i < NR_WB_CLASSES; i++) {
+		if (!list_empty(&bdi->work_list[i])) {
+			work = list_entry(bdi->work_list[i].next,
+					  struct wb_writeback_work, list);
+			list_del_init(&work->list);
+			break;
+		}
 	}
 	spin_unlock_bh(&bdi->wb_lock);
 	return work;
 }
 
+/*
+ * Account a finished or preempted work in the per-class statistics.
+ */
+static void wb_account_work(struct backing_dev_info *bdi,
+			    struct wb_writeback_work *work)
+{
+	struct wb_class_stat *stat = &bdi->wb_class_stat[work->wb_class];
+	unsigned long latency = jiffies - work->queued;
+
+	spin_lock_bh(&bdi->wb_lock);
+	if (work->preempted) {
+		stat->nr_preempted++;
+	} else {
+		stat->nr_works++;
+		stat->total_latency += latency;
+		if (latency > stat->max_latency)
+			stat->max_latency = latency;
+	}
+	spin_unlock_bh(&bdi->wb_lock);
+}
+
+/*
+ * Put a preempted work back at the head of its class, so that it resumes
+ * as soon as the higher class work has been served.
+ */
+static void bdi_requeue_work(struct backing_dev_info *bdi,
+			     struct wb_writeback_work *work)
+{
+	trace_writeback_preempt(bdi, work);
+
+	spin_lock_bh(&bdi->wb_lock);
+	work->preempted = 0;
+	list_add(&work->list, &bdi->work_list[work->wb_class]);
+	spin_unlock_bh(&bdi->wb_lock);
+}
+
 /*
  * Add in the number of potentially dirty inodes, because each inode
  * write can dirty pagecache in the underlying blockdev.
@@ -799,9 +867,14 @@ static long wb_check_background_flush(struct bdi_writeback *wb)
 			.sync_mode	= WB_SYNC_NONE,
 			.for_background	= 1,
 			.range_cyclic	= 1,
+			.wb_class	= WB_CLASS_BACKGROUND,
+			.queued		= jiffies,
 		};
+		long wrote;
 
-		return wb_writeback(wb, &work);
+		wrote = wb_writeback(wb, &work);
+		wb_account_work(wb->bdi, &work);
+		return wrote;
 	}
 
 	return 0;
@@ -832,9 +905,14 @@ static long wb_check_old_data_flush(struct bdi_writeback *wb)
 			.sync_mode	= WB_SYNC_NONE,
 			.for_kupdate	= 1,
 			.range_cyclic	= 1,
+			.wb_class	= WB_CLASS_BACKGROUND,
+			.queued		= jiffies,
 		};
+		long wrote;
 
-		return wb_writeback(wb, &work);
+		wrote = wb_writeback(wb, &work);
+		wb_account_work(wb->bdi, &work);
+		return wrote;
 	}
 
 	return 0;
@@ -861,6 +939,12 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 		trace_writeback_exec(bdi, work);
 
 		wrote += wb_writeback(wb, work);
+		wb_account_work(bdi, work);
+
+		if (work->preempted) {
+			bdi_requeue_work(bdi, work);
+			continue;
+		}
 
 		/*
 		 * Notify the caller of completion if this is a synchronous
@@ -918,7 +1002,7 @@ int bdi_writeback_thread(void *data)
 			wb->last_active = jiffies;
 
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (!list_empty(&bdi->work_list) || kthread_should_stop()) {
+		if (bdi_has_work(bdi) || kthread_should_stop()) {
 			__set_current_state(TASK_RUNNING);
 			continue;
 		}
@@ -938,7 +1022,7 @@ int bdi_writeback_thread(void *data)
 	}
 
 	/* Flush any work that raced with us exiting */
-	if (!list_empty(&bdi->work_list))
+	if (bdi_has_work(bdi))
 		wb_do_writeback(wb, 1);
 
 	trace_writeback_thread_stop(bdi);
@@ -25,43 +25,99 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
-static void fuse_request_init(struct fuse_req *req)
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	return fud ? fud->fc : NULL;
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (!fud)
+		return NULL;
+
+	fud->fc = fuse_conn_get(fc);
+	spin_lock(&fc->lock);
+	fc->num_devs++;
+	spin_unlock(&fc->lock);
+
+	return fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+
+	spin_lock(&fc->lock);
+	fc->num_devs--;
+	spin_unlock(&fc->lock);
+	kfree(fud);
+	fuse_conn_put(fc);
+}
+EXPORT_SYMBOL_GPL(fuse_dev_free);
+
+static void fuse_request_init(struct fuse_req *req, struct page **pages,
+			      unsigned npages)
 {
 	memset(req, 0, sizeof(*req));
 	INIT_LIST_HEAD(&req->list);
 	INIT_LIST_HEAD(&req->intr_entry);
 	init_waitqueue_head(&req->waitq);
 	atomic_set(&req->count, 1);
+	req->pages = pages;
+	req->max_pages = npages;
 }
 
-struct fuse_req *fuse_request_alloc(void)
+static struct fuse_req *__fuse_request_alloc(unsigned npages, gfp_t flags)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_KERNEL);
-	if (req)
-		fuse_request_init(req);
+	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, flags);
+	if (req) {
+		struct page **pages;
+
+		if (npages <= FUSE_REQ_INLINE_PAGES) {
+			pages = req->inline_pages;
+		} else {
+			pages = kmalloc(sizeof(struct page *) * npages, flags);
+			if (!pages) {
+				kmem_cache_free(fuse_req_cachep, req);
+				return NULL;
+			}
+		}
+		fuse_request_init(req, pages, npages);
+	}
 	return req;
 }
+
+struct fuse_req *fuse_request_alloc(void)
+{
+	return __fuse_request_alloc(FUSE_REQ_INLINE_PAGES, GFP_KERNEL);
+}
 EXPORT_SYMBOL_GPL(fuse_request_alloc);
 
-struct fuse_req *fuse_request_alloc_nofs(void)
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_NOFS);
-	if (req)
-		fuse_request_init(req);
-	return req;
+	return __fuse_request_alloc(npages, GFP_NOFS);
 }
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->pages != req->inline_pages)
+		kfree(req->pages);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -97,7 +153,7 @@ static void fuse_req_init_context(struct fuse_req *req)
 	req->in.h.pid = current->pid;
 }
 
-struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages)
 {
 	struct fuse_req *req;
 	sigset_t oldset;
@@ -116,7 +172,7 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	if (!fc->connected)
 		goto out;
 
-	req = fuse_request_alloc();
+	req = __fuse_request_alloc(npages, GFP_KERNEL);
 	err = -ENOMEM;
 	if (!req)
 		goto out;
@@ -129,6 +185,12 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	atomic_dec(&fc->num_waiting);
 	return ERR_PTR(err);
 }
+EXPORT_SYMBOL_GPL(fuse_get_req_pages);
+
+struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+{
+	return fuse_get_req_pages(fc, FUSE_REQ_INLINE_PAGES);
+}
 EXPORT_SYMBOL_GPL(fuse_get_req);
 
 /*
@@ -166,7 +228,7 @@ static void put_reserved_req(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_file *ff = file->private_data;
 
 	spin_lock(&fc->lock);
-	fuse_request_init(req);
+	fuse_request_init(req, req->inline_pages, FUSE_REQ_INLINE_PAGES);
 	BUG_ON(ff->reserved_req);
 	ff->reserved_req = req;
 	wake_up_all(&fc->reserved_req_waitq);
@@ -237,17 +299,37 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+/*
+ * Queue the request on the channel of the submitting CPU.  If a
+ * reader bound to that channel is waiting, wake that one, otherwise
+ * wake any reader of the connection, which will then steal the
+ * request.  If the channel still holds earlier requests, its readers
+ * may all have been woken for those already, so wake a reader of the
+ * connection as well rather than leave this request to wait for them.
+ *
+ * Called with fc->lock held, which also keeps us on this CPU.
+ */
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_chan *chan = this_cpu_ptr(fc->chan);
+	int backlog = !list_empty(&chan->pending);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &chan->pending);
+	fc->num_pending++;
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
+	if (waitqueue_active(&chan->waitq)) {
+		wake_up(&chan->waitq);
+		if (backlog)
+			wake_up(&fc->waitq);
+	} else {
+		wake_up(&fc->waitq);
+	}
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
@@ -372,6 +454,7 @@ __acquires(fc->lock)
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
+			fc->num_pending--;
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
@@ -909,18 +992,59 @@ static int forget_pending(struct fuse_conn *fc)
 
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
+	return fc->num_pending || !list_empty(&fc->interrupts) ||
 		forget_pending(fc);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
+/*
+ * Pick the next pending request for a reader.  A bound reader serves
+ * its own channel first.  Otherwise the channels are scanned round
+ * robin, so that a busy CPU can't starve requests queued elsewhere.
+ *
+ * Called with fc->lock held and fc->num_pending non-zero.
+ */
+static struct fuse_req *next_pending_request(struct fuse_conn *fc,
+					     struct fuse_chan *own)
+{
+	struct fuse_chan *chan;
+	int cpu;
+
+	if (own && !list_empty(&own->pending)) {
+		chan = own;
+		goto found;
+	}
+
+	cpu = fc->chan_next;
+	for (;;) {
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_possible_mask);
+		chan = per_cpu_ptr(fc->chan, cpu);
+		cpu = cpumask_next(cpu, cpu_possible_mask);
+		if (!list_empty(&chan->pending))
+			break;
+	}
+	fc->chan_next = cpu;
+
+ found:
+	fc->num_pending--;
+	return list_entry(chan->pending.next, struct fuse_req, list);
+}
+
+/*
+ * Wait until a request is available on the pending list.  Readers
+ * bound to a channel wait on both the channel and the connection, so
+ * they can pick up work that no one else is waiting for.
+ */
+static void request_wait(struct fuse_conn *fc, struct fuse_chan *own)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
+	DECLARE_WAITQUEUE(chan_wait, current);
 
 	add_wait_queue_exclusive(&fc->waitq, &wait);
+	if (own)
+		add_wait_queue_exclusive(&own->waitq, &chan_wait);
 	while (fc->connected && !request_pending(fc)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
@@ -931,6 +1055,8 @@ __acquires(fc->lock)
 		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
+	if (own)
+		remove_wait_queue(&own->waitq, &chan_wait);
 	remove_wait_queue(&fc->waitq, &wait);
 }
 
@@ -1095,10 +1221,11 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
@@ -1110,7 +1237,7 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	    !request_pending(fc))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fc, fud->chan);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
@@ -1125,14 +1252,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (!fc->num_pending || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = next_pending_request(fc, fud->chan);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
@@ -1186,13 +1313,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1220,18 +1347,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(in);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fud->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1483,12 +1610,14 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	unsigned int offset;
 	size_t total_len = 0;
 
-	req = fuse_get_req(fc);
+	offset = outarg->offset & ~PAGE_CACHE_MASK;
+	num = min_t(unsigned, outarg->size, fc->max_pages << PAGE_CACHE_SHIFT);
+
+	req = fuse_get_req_pages(fc, DIV_ROUND_UP(num + offset,
+						  PAGE_CACHE_SIZE));
 	if (IS_ERR(req))
 		return PTR_ERR(req);
 
-	offset = outarg->offset & ~PAGE_CACHE_MASK;
-
 	req->in.h.opcode = FUSE_NOTIFY_REPLY;
 	req->in.h.nodeid = outarg->nodeid;
 	req->in.numargs = 2;
@@ -1498,7 +1627,6 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 
 	index = outarg->offset >> PAGE_CACHE_SHIFT;
 	file_size = i_size_read(inode);
-	num = outarg->size;
 	if (outarg->offset > file_size)
 		num = 0;
 	else if (outarg->offset + num > file_size)
@@ -1508,6 +1636,9 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		struct page *page;
 		unsigned int this_num;
 
+		if (req->num_pages == req->max_pages)
+			break;
+
 		page = find_get_page(mapping, index);
 		if (!page)
 			break;
@@ -1516,8 +1647,10 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		req->pages[req->num_pages] = page;
 		req->num_pages++;
 
+		offset = 0;
 		num -= this_num;
 		total_len += this_num;
+		index++;
 	}
 	req->misc.retrieve_in.offset = outarg->offset;
 	req->misc.retrieve_in.size = total_len;
@@ -1825,11 +1958,15 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	if (!fud)
 		return POLLERR;
 
+	fc = fud->fc;
 	poll_wait(file, &fc->waitq, wait);
+	if (fud->chan)
+		poll_wait(file, &fud->chan->waitq, wait);
 
 	spin_lock(&fc->lock);
 	if (!fc->connected)
@@ -1900,9 +2037,13 @@ static void end_queued_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	int cpu;
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
+	for_each_possible_cpu(cpu)
+		end_requests(fc, &per_cpu_ptr(fc->chan, cpu)->pending);
+	fc->num_pending = 0;
 	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
@@ -1959,17 +2100,29 @@ void fuse_abort_conn(struct fuse_conn *fc)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * The connection is shut down when its last device file is released.
+ * If other files remain, the requests left on the channel of this
+ * one are handed over to whichever reader comes next.
+ */
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud) {
+		struct fuse_conn *fc = fud->fc;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		if (--fc->num_devs == 0) {
+			fc->connected = 0;
+			fc->blocked = 0;
+			end_queued_requests(fc);
+			end_polls(fc);
+			wake_up_all(&fc->blocked_waitq);
+		} else if (fud->chan && !list_empty(&fud->chan->pending)) {
+			wake_up(&fc->waitq);
+		}
 		spin_unlock(&fc->lock);
+		kfree(fud);
 		fuse_conn_put(fc);
 	}
 
@@ -1977,6 +2130,58 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+static int fuse_device_clone(struct file *new, struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_dev *new_fud;
+
+	/* A file can only be attached to a single connection */
+	if (new->private_data)
+		return -EINVAL;
+
+	new_fud = fuse_dev_alloc(fc);
+	if (!new_fud)
+		return -ENOMEM;
+
+	/* Bind to the channel of the CPU the daemon thread runs on */
+	new_fud->chan = per_cpu_ptr(fc->chan, raw_smp_processor_id());
+	new->private_data = new_fud;
+
+	return 0;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	int err = -ENOTTY;
+
+	if (cmd == FUSE_DEV_IOC_CLONE) {
+		struct file *old;
+		u32 oldfd;
+
+		if (get_user(oldfd, (u32 __user *) arg))
+			return -EFAULT;
+
+		old = fget(oldfd);
+		if (!old)
+			return -EINVAL;
+
+		/* Only clone between files of the same device */
+		err = -EINVAL;
+		if (old->f_op == file->f_op) {
+			struct fuse_dev *fud = fuse_get_dev(old);
+
+			mutex_lock(&fuse_mutex);
+			if (fud)
+				err = fuse_device_clone(file, fud);
+			mutex_unlock(&fuse_mutex);
+		}
+		fput(old);
+	}
+
+	return err;
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -1999,6 +2204,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl = fuse_dev_ioctl,
+	.compat_ioctl   = fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
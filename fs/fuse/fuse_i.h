@@ -23,8 +23,14 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Upper limit for the number of pages negotiated with FUSE_MAX_PAGES */
+#define FUSE_MAX_MAX_PAGES 256
+
+/** Number of page pointers embedded in fuse_req */
+#define FUSE_REQ_INLINE_PAGES FUSE_DEFAULT_MAX_PAGES_PER_REQ
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -285,7 +291,13 @@ struct fuse_req {
 	} misc;
 
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the 'pages' array */
+	unsigned max_pages;
+
+	/** inline page vector */
+	struct page *inline_pages[FUSE_REQ_INLINE_PAGES];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -309,6 +321,33 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A request channel.
+ *
+ * Requests are queued on the channel of the CPU they were submitted
+ * on.  Device files bound to a channel with FUSE_DEV_IOC_CLONE are
+ * woken for requests on that channel first, and only steal from
+ * other channels when their own one is empty.
+ */
+struct fuse_chan {
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Readers bound to this channel are waiting on this */
+	wait_queue_head_t waitq;
+};
+
+/**
+ * An open /dev/fuse file attached to a connection
+ */
+struct fuse_dev {
+	/** The connection */
+	struct fuse_conn *fc;
+
+	/** Channel this file is bound to, or NULL to serve all channels */
+	struct fuse_chan *chan;
+};
+
 /**
  * A Fuse connection.
  *
@@ -341,11 +380,23 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
+
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU channels holding the pending requests */
+	struct fuse_chan __percpu *chan;
+
+	/** Number of requests pending on all channels */
+	unsigned num_pending;
+
+	/** Channel the next unbound reader starts scanning from */
+	int chan_next;
+
+	/** Number of device files attached to this connection */
+	unsigned num_devs;
 
 	/** The list of requests being processed */
 	struct list_head processing;
@@ -472,6 +523,9 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Buffered writes are cached and written back with writepages */
+	unsigned writeback_cache:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -644,7 +698,7 @@ void fuse_ctl_cleanup(void);
  */
 struct fuse_req *fuse_request_alloc(void);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -656,6 +710,12 @@ void fuse_request_free(struct fuse_req *req);
  */
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+/**
+ * Get a request with room for at least 'npages' pages, may fail with
+ * -ENOMEM
+ */
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 /**
  * Gets a requests for a file operation, always succeeds
  */
@@ -700,7 +760,7 @@ void fuse_conn_kill(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -761,6 +821,12 @@ long fuse_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg,
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
 
+/**
+ * Attach a device file to fuse_conn, acquiring a reference to it
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+void fuse_dev_free(struct fuse_dev *fud);
+
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
 #endif /* _FS_FUSE_I_H */
@@ -23,6 +23,8 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <trace/events/jbd2.h>
 
 /*
@@ -175,6 +177,95 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 	}
 }
 
+/*
+ * jbd2_log_wake_checkpoint: kick the background checkpoint thread.
+ *
+ * Called after a commit has consumed log space.  Cheap enough to be
+ * called unconditionally; the thread checks for itself whether there is
+ * anything to do.
+ */
+void jbd2_log_wake_checkpoint(journal_t *journal)
+{
+	if (journal->j_checkpoint_task)
+		wake_up(&journal->j_wait_checkpoint);
+}
+
+static int jbd2_checkpoint_pending(journal_t *journal)
+{
+	int ret;
+
+	read_lock(&journal->j_state_lock);
+	ret = jbd2_log_need_checkpoint(journal) ||
+		(journal->j_flags & JBD2_CLEAN_CHECKPOINT);
+	read_unlock(&journal->j_state_lock);
+	return ret;
+}
+
+/*
+ * jbd2_checkpoint_thread: background checkpointing.
+ *
+ * Keeps enough free space in the log that start_this_handle() does not
+ * have to checkpoint synchronously, and takes the cleanup of the
+ * checkpoint lists off the commit path.  While the log still has room
+ * for a full transaction the thread writes out one transaction at a
+ * time and pauses j_checkpoint_delay between passes, so that it does not
+ * compete with the commit and data writeback for the disk; once space
+ * is really short it checkpoints back to back.  A pass that frees no
+ * log space, because the transactions pinning the log are still being
+ * committed, waits for the next commit before trying again.
+ */
+int jbd2_checkpoint_thread(void *arg)
+{
+	journal_t *journal = arg;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		int urgent, space, freed;
+		tid_t commit;
+
+		wait_event_freezable(journal->j_wait_checkpoint,
+				     (jbd2_checkpoint_pending(journal) &&
+				      !is_journal_aborted(journal)) ||
+				     kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+
+		mutex_lock(&journal->j_checkpoint_mutex);
+
+		write_lock(&journal->j_state_lock);
+		journal->j_flags &= ~JBD2_CLEAN_CHECKPOINT;
+		write_unlock(&journal->j_state_lock);
+
+		spin_lock(&journal->j_list_lock);
+		__jbd2_journal_clean_checkpoint_list(journal);
+		spin_unlock(&journal->j_list_lock);
+
+		read_lock(&journal->j_state_lock);
+		space = __jbd2_log_space_left(journal);
+		urgent = space < jbd_space_needed(journal);
+		commit = journal->j_commit_sequence;
+		read_unlock(&journal->j_state_lock);
+
+		if (jbd2_checkpoint_pending(journal) &&
+		    !is_journal_aborted(journal))
+			jbd2_log_do_checkpoint(journal);
+
+		read_lock(&journal->j_state_lock);
+		freed = __jbd2_log_space_left(journal) > space;
+		read_unlock(&journal->j_state_lock);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+
+		if (!freed)
+			wait_event_freezable_timeout(journal->j_wait_checkpoint,
+				journal->j_commit_sequence != commit ||
+				kthread_should_stop(), HZ);
+		else if (!urgent && journal->j_checkpoint_delay)
+			schedule_timeout_interruptible(
+					journal->j_checkpoint_delay);
+	}
+	return 0;
+}
+
 /*
  * We were unable to perform jbd_trylock_bh_state() inside j_list_lock.
  * The caller must restart a list walk.  Wait for someone else to run
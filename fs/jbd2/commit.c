@@ -428,11 +428,15 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	/*
 	 * Now try to drop any written-back buffers from the journal's
 	 * checkpoint lists.  We do this *before* commit because it potentially
-	 * frees some memory
+	 * frees some memory.  New handles are blocked while the transaction
+	 * is T_LOCKED, so if there is a checkpoint thread it does this for
+	 * us once the commit is done.
 	 */
-	spin_lock(&journal->j_list_lock);
-	__jbd2_journal_clean_checkpoint_list(journal);
-	spin_unlock(&journal->j_list_lock);
+	if (!journal->j_checkpoint_task) {
+		spin_lock(&journal->j_list_lock);
+		__jbd2_journal_clean_checkpoint_list(journal);
+		spin_unlock(&journal->j_list_lock);
+	}
 
 	jbd_debug (3, "JBD: commit phase 1\n");
 
@@ -989,6 +993,8 @@ restart_loop:
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
+	if (journal->j_checkpoint_task)
+		journal->j_flags |= JBD2_CLEAN_CHECKPOINT;
 	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
@@ -1034,4 +1040,5 @@ restart_loop:
 		kfree(commit_transaction);
 
 	wake_up(&journal->j_wait_done_commit);
+	jbd2_log_wake_checkpoint(journal);
 }
@@ -44,6 +44,8 @@
 #include <linux/backing-dev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
+#include <linux/crc32.h>
+#include <linux/blkdev.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -85,6 +87,10 @@ EXPORT_SYMBOL(jbd2_log_wait_commit);
 EXPORT_SYMBOL(jbd2_log_start_commit);
 EXPORT_SYMBOL(jbd2_journal_start_commit);
 EXPORT_SYMBOL(jbd2_journal_force_commit_nested);
+EXPORT_SYMBOL(jbd2_journal_account_fsync);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_commit);
+EXPORT_SYMBOL(jbd2_fc_replay);
 EXPORT_SYMBOL(jbd2_journal_wipe);
 EXPORT_SYMBOL(jbd2_journal_blocks_per_page);
 EXPORT_SYMBOL(jbd2_journal_invalidatepage);
@@ -232,11 +238,28 @@ static int jbd2_journal_start_thread(journal_t *journal)
 		return PTR_ERR(t);
 
 	wait_event(journal->j_wait_done_commit, journal->j_task != NULL);
+
+	/*
+	 * The checkpoint thread is an optimisation only: without it,
+	 * checkpointing is done synchronously by start_this_handle().
+	 */
+	t = kthread_run(jbd2_checkpoint_thread, journal, "jbd2-ckpt/%s",
+			journal->j_devname);
+	if (IS_ERR(t))
+		printk(KERN_WARNING "JBD2: cannot start checkpoint thread "
+		       "for %s: %ld\n", journal->j_devname, PTR_ERR(t));
+	else
+		journal->j_checkpoint_task = t;
 	return 0;
 }
 
 static void journal_kill_thread(journal_t *journal)
 {
+	if (journal->j_checkpoint_task) {
+		kthread_stop(journal->j_checkpoint_task);
+		journal->j_checkpoint_task = NULL;
+	}
+
 	write_lock(&journal->j_state_lock);
 	journal->j_flags |= JBD2_UNMOUNT;
 
@@ -610,6 +633,26 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid)
 	return err;
 }
 
+/**
+ * void jbd2_journal_account_fsync() - record the latency of an fsync
+ * @journal: journal the fsync went through
+ * @start: time at which the fsync started
+ *
+ * Feeds the fsync latency histogram reported in /proc/fs/jbd2/<dev>/info.
+ */
+void jbd2_journal_account_fsync(journal_t *journal, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+
+	if (us > 1)
+		bucket = min_t(int, fls64(us) - 1, JBD2_FSYNC_HIST_BUCKETS - 1);
+
+	spin_lock(&journal->j_history_lock);
+	journal->j_stats.ts_fsync_hist[bucket]++;
+	spin_unlock(&journal->j_history_lock);
+}
+
 /*
  * Log buffer allocation routines:
  */
@@ -709,6 +752,40 @@ static void *jbd2_seq_info_next(struct seq_file *seq, void *v, loff_t *pos)
 	return NULL;
 }
 
+/*
+ * Percentiles are reported as the upper bound of the histogram bucket
+ * they fall in, so they are accurate to a factor of two.
+ */
+static void jbd2_seq_fsync_show(struct seq_file *seq,
+				struct transaction_stats_s *stats)
+{
+	static const unsigned int pct[] = { 500, 900, 990, 999 };
+	unsigned long total = 0, sum, want;
+	int i, b;
+
+	for (b = 0; b < JBD2_FSYNC_HIST_BUCKETS; b++)
+		total += stats->ts_fsync_hist[b];
+	if (!total)
+		return;
+
+	seq_printf(seq, "fsync latency (%lu fsyncs):\n", total);
+	for (i = 0; i < ARRAY_SIZE(pct); i++) {
+		want = div_u64((u64)total * pct[i] + 999, 1000);
+		sum = 0;
+		for (b = 0; b < JBD2_FSYNC_HIST_BUCKETS - 1; b++) {
+			sum += stats->ts_fsync_hist[b];
+			if (sum >= want)
+				break;
+		}
+		if (b == JBD2_FSYNC_HIST_BUCKETS - 1)
+			seq_printf(seq, "  p%u.%u >= %luus\n", pct[i] / 10,
+				   pct[i] % 10, 1UL << b);
+		else
+			seq_printf(seq, "  p%u.%u < %luus\n", pct[i] / 10,
+				   pct[i] % 10, 1UL << (b + 1));
+	}
+}
+
 static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 {
 	struct jbd2_stats_proc_session *s = seq->private;
@@ -738,6 +815,7 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	jbd2_seq_fsync_show(seq, s->stats);
 	return 0;
 }
 
@@ -844,11 +922,14 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_updates);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	mutex_init(&journal->j_fc_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	rwlock_init(&journal->j_state_lock);
 
 	journal->j_commit_interval = (HZ * JBD2_DEFAULT_MAX_COMMIT_AGE);
+	journal->j_checkpoint_delay =
+		msecs_to_jiffies(JBD2_DEFAULT_CHECKPOINT_DELAY);
 	journal->j_min_batch_time = 0;
 	journal->j_max_batch_time = 15000; /* 15ms */
 
@@ -1039,7 +1120,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - journal->j_fc_blocks;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1228,6 +1309,23 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	/* The fast commit area is carved off the end of the log */
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_LOCAL_FC)) {
+		unsigned int nfc = be32_to_cpu(sb->s_num_fc_blks);
+
+		if (!nfc || journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + nfc >
+			    journal->j_last + 1) {
+			printk(KERN_WARNING "JBD: bad fast commit area size %u\n",
+			       nfc);
+			journal_fail_superblock(journal);
+			return -EINVAL;
+		}
+		journal->j_last -= nfc;
+		journal->j_fc_first = journal->j_last;
+		journal->j_fc_blocks = nfc;
+	}
+
 	return 0;
 }
 
@@ -1273,9 +1371,18 @@ int jbd2_journal_load(journal_t *journal)
 
 	/* Let the recovery code check whether it needs to recover any
 	 * data from the journal. */
+	if (sb->s_start && journal->j_fc_blocks)
+		journal->j_flags |= JBD2_FC_REPLAY;
 	if (jbd2_journal_recover(journal))
 		goto recovery_error;
 
+	/*
+	 * Recovery restarts the log two transaction IDs past the last one
+	 * it found complete; fast commits written on top of that one are
+	 * still valid.
+	 */
+	journal->j_fc_replay_tid = journal->j_transaction_sequence - 2;
+
 	if (journal->j_failed_commit) {
 		printk(KERN_ERR "JBD2: journal transaction %u on %s "
 		       "is corrupt.\n", journal->j_failed_commit,
@@ -1298,6 +1405,255 @@ recovery_error:
 	return -EIO;
 }
 
+/**
+ * int jbd2_fc_init() - Set up a fast commit area on the journal.
+ * @journal: Journal to act on.
+ * @nblocks: Number of blocks to reserve at the end of the log.
+ *
+ * Carve @nblocks blocks off the tail of the log for fast commits and
+ * record that in the journal superblock.  The log must be empty, i.e.
+ * flushed with updates locked out.  A journal which already has a fast
+ * commit area keeps the size it was created with.
+ *
+ * This sets an incompatible feature that older kernels and e2fsck do
+ * not know, so it must only ever run on an explicit request from the
+ * administrator, never as a side effect of mounting.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int nblocks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	struct buffer_head *bh = journal->j_sb_buffer;
+	int err = 0;
+
+	if (journal->j_fc_blocks)
+		return 0;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_checkpoint_transactions ||
+	    journal->j_head != journal->j_tail) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (!nblocks || journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + nblocks >
+			journal->j_last + 1) {
+		err = -ENOSPC;
+		goto out;
+	}
+	if (!jbd2_journal_set_features(journal, 0, 0,
+				       JBD2_FEATURE_INCOMPAT_LOCAL_FC)) {
+		err = -EINVAL;
+		goto out;
+	}
+	/* Nothing is logged, so the log can restart clear of the area */
+	if (journal->j_head >= journal->j_last - nblocks) {
+		journal->j_head = journal->j_tail = journal->j_first;
+		if (sb->s_start)
+			sb->s_start = cpu_to_be32(journal->j_tail);
+	}
+	sb->s_num_fc_blks = cpu_to_be32(nblocks);
+	journal->j_last -= nblocks;
+	journal->j_free -= nblocks;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_blocks = nblocks;
+	journal->j_fc_off = 0;
+	journal->j_fc_base = journal->j_commit_sequence;
+out:
+	write_unlock(&journal->j_state_lock);
+	if (err)
+		return err;
+
+	/*
+	 * jbd2_journal_update_superblock() skips the write for an empty
+	 * journal, so push the new feature bits out by hand.
+	 */
+	lock_buffer(bh);
+	mark_buffer_dirty(bh);
+	unlock_buffer(bh);
+	return sync_dirty_buffer(bh);
+}
+
+/*
+ * The checksum of a fast commit block covers its header up to the
+ * checksum field, then the payload.
+ */
+static __u32 jbd2_fc_csum(jbd2_fc_header_t *fch, unsigned int len)
+{
+	__u32 csum;
+
+	csum = crc32_be(~0, (u8 *)fch, offsetof(jbd2_fc_header_t, fc_crc32));
+	return crc32_be(csum, (u8 *)(fch + 1), len);
+}
+
+/**
+ * int jbd2_fc_commit() - Write one fast commit block.
+ * @journal: Journal to act on.
+ * @data: Filesystem payload to record.
+ * @len: Length of @data in bytes.
+ *
+ * Append one block to the fast commit area and wait for it to reach
+ * stable storage.  The block is tagged with the last committed
+ * transaction; recovery replays it only if that transaction is still
+ * the newest complete one in the log, i.e. only if the running
+ * transaction never made it to disk.
+ *
+ * Returns -EAGAIN if the caller must fall back to a full commit,
+ * -ENOSPC if the area is full, and 0 on success.
+ */
+int jbd2_fc_commit(journal_t *journal, const void *data, int len)
+{
+	struct buffer_head *bh;
+	jbd2_fc_header_t *fch;
+	unsigned long long blocknr;
+	tid_t base, committing;
+	int err;
+
+	if (!journal->j_fc_blocks ||
+	    len > journal->j_blocksize - (int)sizeof(jbd2_fc_header_t))
+		return -EINVAL;
+
+	mutex_lock(&journal->j_fc_mutex);
+again:
+	read_lock(&journal->j_state_lock);
+	if (is_journal_aborted(journal) ||
+	    (journal->j_flags & JBD2_FLUSHED)) {
+		read_unlock(&journal->j_state_lock);
+		err = -EAGAIN;
+		goto out;
+	}
+	if (journal->j_committing_transaction) {
+		/*
+		 * Our base is about to move: wait so that the record is
+		 * tagged with the transaction which will actually be the
+		 * last one on disk.
+		 */
+		committing = journal->j_committing_transaction->t_tid;
+		read_unlock(&journal->j_state_lock);
+		jbd2_log_wait_commit(journal, committing);
+		goto again;
+	}
+	base = journal->j_commit_sequence;
+	read_unlock(&journal->j_state_lock);
+
+	if (base != journal->j_fc_base) {
+		journal->j_fc_base = base;
+		journal->j_fc_off = 0;
+	}
+	if (journal->j_fc_off >= journal->j_fc_blocks) {
+		err = -ENOSPC;
+		goto out;
+	}
+
+	err = jbd2_journal_bmap(journal,
+				journal->j_fc_first + journal->j_fc_off,
+				&blocknr);
+	if (err)
+		goto out;
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	fch = (jbd2_fc_header_t *)bh->b_data;
+	fch->fc_header.h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	fch->fc_header.h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	fch->fc_header.h_sequence = cpu_to_be32(base);
+	fch->fc_index = cpu_to_be32(journal->j_fc_off);
+	fch->fc_len = cpu_to_be32(len);
+	memcpy(fch + 1, data, len);
+	fch->fc_crc32 = cpu_to_be32(jbd2_fc_csum(fch, len));
+
+	/*
+	 * The payload may describe data blocks the caller just wrote to an
+	 * external filesystem device; make sure they are stable first.
+	 */
+	if ((journal->j_flags & JBD2_BARRIER) &&
+	    journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(journal->j_fs_dev, GFP_KERNEL, NULL);
+
+	set_buffer_uptodate(bh);
+	clear_buffer_dirty(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(journal->j_flags & JBD2_BARRIER ?
+		  WRITE_SYNC | WRITE_FLUSH_FUA : WRITE_SYNC, bh);
+	wait_on_buffer(bh);
+	if (!buffer_uptodate(bh))
+		err = -EIO;
+	else
+		journal->j_fc_off++;
+	__brelse(bh);
+out:
+	mutex_unlock(&journal->j_fc_mutex);
+	return err;
+}
+
+/**
+ * int jbd2_fc_replay() - Walk fast commit blocks left by a crash.
+ * @journal: Journal to act on.
+ * @fn: Called for the payload of every valid block, in order.
+ * @priv: Passed through to @fn.
+ *
+ * Must be called after jbd2_journal_load(), once the filesystem is ready
+ * to apply updates.  Does nothing unless recovery ran on this mount.
+ * Stops at the first block which does not belong to the last committed
+ * transaction or fails its checksum, or when @fn returns an error.
+ */
+int jbd2_fc_replay(journal_t *journal,
+		   int (*fn)(journal_t *, const void *, int, void *),
+		   void *priv)
+{
+	struct buffer_head *bh;
+	jbd2_fc_header_t *fch;
+	unsigned long long blocknr;
+	tid_t tid = journal->j_fc_replay_tid;
+	unsigned int i, len;
+	int err = 0;
+
+	if (!(journal->j_flags & JBD2_FC_REPLAY))
+		return 0;
+
+	mutex_lock(&journal->j_fc_mutex);
+	for (i = 0; i < journal->j_fc_blocks; i++) {
+		err = jbd2_journal_bmap(journal, journal->j_fc_first + i,
+					&blocknr);
+		if (err)
+			break;
+		bh = __bread(journal->j_dev, blocknr, journal->j_blocksize);
+		if (!bh) {
+			err = -EIO;
+			break;
+		}
+		fch = (jbd2_fc_header_t *)bh->b_data;
+		len = be32_to_cpu(fch->fc_len);
+		if (fch->fc_header.h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    be32_to_cpu(fch->fc_header.h_blocktype) != JBD2_FC_BLOCK ||
+		    be32_to_cpu(fch->fc_header.h_sequence) != tid ||
+		    be32_to_cpu(fch->fc_index) != i ||
+		    len > journal->j_blocksize - sizeof(*fch) ||
+		    be32_to_cpu(fch->fc_crc32) != jbd2_fc_csum(fch, len)) {
+			brelse(bh);
+			break;
+		}
+		err = fn(journal, fch + 1, len, priv);
+		brelse(bh);
+		if (err)
+			break;
+	}
+	jbd_debug(1, "JBD: replayed %u fast commit blocks for tid %u\n",
+		  i, tid);
+
+	journal->j_flags &= ~JBD2_FC_REPLAY;
+	journal->j_fc_base = tid;
+	journal->j_fc_off = i;
+	mutex_unlock(&journal->j_fc_mutex);
+	return err;
+}
+
 /**
  * void jbd2_journal_destroy() - Release a journal_t structure.
  * @journal: Journal to act on.
@@ -79,6 +79,43 @@ int dcache_dir_close(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/*
+ * Move the readdir cursor of a dcache directory by @n positive entries,
+ * forwards if @n is positive and backwards otherwise.  Called with the
+ * directory locked and its ->d_lock held; cursors of other readers and
+ * negative dentries are skipped.
+ */
+static void dcache_cursor_move(struct dentry *dentry, struct dentry *cursor,
+			       loff_t n)
+{
+	struct list_head *head = &dentry->d_subdirs;
+	struct list_head *p;
+	struct dentry *next;
+
+	if (n >= 0) {
+		for (p = cursor->d_u.d_child.next; n && p != head; p = p->next) {
+			next = list_entry(p, struct dentry, d_u.d_child);
+			spin_lock_nested(&next->d_lock, DENTRY_D_LOCK_NESTED);
+			if (simple_positive(next))
+				n--;
+			spin_unlock(&next->d_lock);
+		}
+		/* d_lock not required for cursor */
+		list_del(&cursor->d_u.d_child);
+		list_add_tail(&cursor->d_u.d_child, p);
+	} else {
+		for (p = cursor->d_u.d_child.prev; n && p != head; p = p->prev) {
+			next = list_entry(p, struct dentry, d_u.d_child);
+			spin_lock_nested(&next->d_lock, DENTRY_D_LOCK_NESTED);
+			if (simple_positive(next))
+				n++;
+			spin_unlock(&next->d_lock);
+		}
+		list_del(&cursor->d_u.d_child);
+		list_add(&cursor->d_u.d_child, p);
+	}
+}
+
 loff_t dcache_dir_lseek(struct file *file, loff_t offset, int origin)
 {
 	struct dentry *dentry = file->f_path.dentry;
@@ -94,28 +131,28 @@ loff_t dcache_dir_lseek(struct file *file, loff_t offset, int origin)
 			return -EINVAL;
 	}
 	if (offset != file->f_pos) {
-		file->f_pos = offset;
-		if (file->f_pos >= 2) {
-			struct list_head *p;
+		if (offset >= 2) {
 			struct dentry *cursor = file->private_data;
-			loff_t n = file->f_pos - 2;
+			loff_t n = offset - 2;
 
 			spin_lock(&dentry->d_lock);
-			/* d_lock not required for cursor */
-			list_del(&cursor->d_u.d_child);
-			p = dentry->d_subdirs.next;
-			while (n && p != &dentry->d_subdirs) {
-				struct dentry *next;
-				next = list_entry(p, struct dentry, d_u.d_child);
-				spin_lock_nested(&next->d_lock, DENTRY_D_LOCK_NESTED);
-				if (simple_positive(next))
-					n--;
-				spin_unlock(&next->d_lock);
-				p = p->next;
+			/*
+			 * With f_pos >= 2 the cursor sits right after entry
+			 * f_pos - 2, so seeking relative to it costs only the
+			 * distance moved.  That keeps telldir()/seekdir() and
+			 * resumed scans of large directories linear overall.
+			 */
+			if (file->f_pos >= 2 &&
+			    abs64(offset - file->f_pos) <= n) {
+				n = offset - file->f_pos;
+			} else {
+				/* d_lock not required for cursor */
+				list_move(&cursor->d_u.d_child, &dentry->d_subdirs);
 			}
-			list_add_tail(&cursor->d_u.d_child, p);
+			dcache_cursor_move(dentry, cursor, n);
 			spin_unlock(&dentry->d_lock);
 		}
+		file->f_pos = offset;
 	}
 	mutex_unlock(&dentry->d_inode->i_mutex);
 	return offset;
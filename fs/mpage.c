@@ -360,30 +360,47 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 				unsigned nr_pages, get_block_t get_block)
 {
 	struct bio *bio = NULL;
-	unsigned page_idx;
+	unsigned page_idx, first;
 	sector_t last_block_in_bio = 0;
 	struct buffer_head map_bh;
 	unsigned long first_logical_block = 0;
 	struct blk_plug plug;
+	struct pagevec pvec;
+	int i;
 
 	blk_start_plug(&plug);
 
 	map_bh.b_state = 0;
 	map_bh.b_size = 0;
-	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = list_entry(pages->prev, struct page, lru);
-
-		prefetchw(&page->flags);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			bio = do_mpage_readpage(bio, page,
-					nr_pages - page_idx,
-					&last_block_in_bio, &map_bh,
-					&first_logical_block,
-					get_block);
+	pagevec_init(&pvec, 0);
+	for (page_idx = 0; page_idx < nr_pages; ) {
+		/* insert a pagevec's worth under one tree_lock hold */
+		first = page_idx;
+		do {
+			struct page *page = list_entry(pages->prev,
+						       struct page, lru);
+
+			prefetchw(&page->flags);
+			list_del(&page->lru);
+			page_idx++;
+			if (!pagevec_add(&pvec, page))
+				break;
+		} while (page_idx < nr_pages);
+
+		add_to_page_cache_lru_batch(&pvec, mapping, GFP_KERNEL);
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			if (page->mapping == mapping) {
+				bio = do_mpage_readpage(bio, page,
+						nr_pages - first - i,
+						&last_block_in_bio, &map_bh,
+						&first_logical_block,
+						get_block);
+			}
+			page_cache_release(page);
 		}
-		page_cache_release(page);
+		pagevec_reinit(&pvec);
 	}
 	BUG_ON(!list_empty(pages));
 	if (bio)
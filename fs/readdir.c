@@ -14,6 +14,10 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/dirent.h>
+#include <linux/dirent_stat.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
+#include <linux/fs_struct.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
@@ -309,3 +313,233 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 out:
 	return error;
 }
+
+/*
+ * getdents_stat() returns the entries of a directory together with their
+ * attributes, saving the stat() per entry that scanners otherwise issue.
+ * Entries are first collected into a kernel batch under the directory
+ * lock, then looked up - from the dcache when they are cached there -
+ * and stat'ed with the directory unlocked.
+ */
+struct dirstat_entry {
+	u64		ino;
+	loff_t		off;
+	unsigned int	d_type;
+	int		namlen;
+	char		name[0];
+};
+
+#define DIRSTAT_BATCH_SIZE	PAGE_SIZE
+
+struct getdents_stat_callback {
+	char		*batch;
+	int		used;		/* bytes of the batch in use */
+	int		nr;		/* entries in the batch */
+	int		batch_full;
+	unsigned int	count;		/* user buffer not yet claimed */
+	int		error;
+};
+
+static int filldir_stat(void *__buf, const char *name, int namlen,
+			loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct getdents_stat_callback *buf = __buf;
+	struct dirstat_entry *de;
+	int reclen = ALIGN(offsetof(struct linux_dirent_stat, d_name) +
+			   namlen + 1, sizeof(u64));
+	int size = ALIGN(offsetof(struct dirstat_entry, name) + namlen + 1,
+			 sizeof(u64));
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+	if (buf->used + size > DIRSTAT_BATCH_SIZE) {
+		buf->error = 0;
+		buf->batch_full = 1;
+		return -EINVAL;
+	}
+	de = (struct dirstat_entry *)(buf->batch + buf->used);
+	de->ino = ino;
+	de->off = offset;
+	de->d_type = d_type;
+	de->namlen = namlen;
+	memcpy(de->name, name, namlen);
+	de->name[namlen] = 0;
+	buf->used += size;
+	buf->nr++;
+	buf->count -= reclen;
+	return 0;
+}
+
+/*
+ * Resolve ".." of the directory being read the way path walking does:
+ * stay at the caller's root, and step out of a mount root into the
+ * mountpoint it covers rather than to the parent dentry of the mounted
+ * tree.
+ */
+static void dirstat_dotdot(struct file *file, struct path *path)
+{
+	struct path root;
+
+	get_fs_root(current->fs, &root);
+	*path = file->f_path;
+	path_get(path);
+	for (;;) {
+		struct dentry *old = path->dentry;
+
+		if (path->dentry == root.dentry && path->mnt == root.mnt)
+			break;
+		if (path->dentry != path->mnt->mnt_root) {
+			path->dentry = dget_parent(path->dentry);
+			dput(old);
+			break;
+		}
+		if (!follow_up(path))
+			break;
+	}
+	path_put(&root);
+}
+
+static int dirstat_getattr(struct file *file, struct dirstat_entry *de,
+			   struct kstat *stat)
+{
+	struct dentry *parent = file->f_path.dentry;
+	struct inode *dir = parent->d_inode;
+	struct qstr this = { .name = (const unsigned char *)de->name,
+			     .len = de->namlen };
+	struct path path;
+	int error;
+
+	if (de->namlen == 1 && de->name[0] == '.') {
+		path.dentry = dget(parent);
+	} else if (de->namlen == 2 && de->name[0] == '.' &&
+		   de->name[1] == '.') {
+		dirstat_dotdot(file, &path);
+		goto got_path;
+	} else {
+		path.dentry = d_hash_and_lookup(parent, &this);
+		/* let the filesystem revalidate through a real lookup */
+		if (path.dentry &&
+		    (path.dentry->d_flags & DCACHE_OP_REVALIDATE)) {
+			dput(path.dentry);
+			path.dentry = NULL;
+		}
+		if (!path.dentry) {
+			mutex_lock(&dir->i_mutex);
+			path.dentry = lookup_one_len(de->name, parent,
+						     de->namlen);
+			mutex_unlock(&dir->i_mutex);
+			if (IS_ERR(path.dentry))
+				return PTR_ERR(path.dentry);
+		}
+	}
+
+	if (!path.dentry->d_inode) {
+		dput(path.dentry);
+		return -ENOENT;
+	}
+	path.mnt = mntget(file->f_path.mnt);
+got_path:
+	while (d_mountpoint(path.dentry) && follow_down_one(&path))
+		;
+	error = vfs_getattr(path.mnt, path.dentry, stat);
+	path_put(&path);
+	return error;
+}
+
+/*
+ * Look up and copy out the batch collected by filldir_stat().  Entries
+ * whose attributes cannot be read (raced with unlink, no search
+ * permission, ...) are still returned, with d_mode set to zero.
+ */
+static int dirstat_emit(struct file *file, struct getdents_stat_callback *buf,
+			int may_search, struct linux_dirent_stat __user **pdirent)
+{
+	struct linux_dirent_stat __user *dirent = *pdirent;
+	struct dirstat_entry *de = (struct dirstat_entry *)buf->batch;
+	struct linux_dirent_stat tmp;
+	struct kstat stat;
+	int i;
+
+	for (i = 0; i < buf->nr; i++) {
+		struct dirstat_entry *next;
+		int size = ALIGN(offsetof(struct dirstat_entry, name) +
+				 de->namlen + 1, sizeof(u64));
+
+		next = (struct dirstat_entry *)((char *)de + size);
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.d_ino = de->ino;
+		tmp.d_off = i + 1 < buf->nr ? next->off : file->f_pos;
+		tmp.d_reclen = ALIGN(offsetof(struct linux_dirent_stat, d_name) +
+				     de->namlen + 1, sizeof(u64));
+		tmp.d_type = de->d_type;
+		if (may_search && !dirstat_getattr(file, de, &stat)) {
+			tmp.d_ino = stat.ino;
+			tmp.d_size = stat.size;
+			tmp.d_mtime = stat.mtime.tv_sec;
+			tmp.d_mtime_nsec = stat.mtime.tv_nsec;
+			tmp.d_mode = stat.mode;
+			tmp.d_uid = stat.uid;
+			tmp.d_gid = stat.gid;
+		}
+
+		if (__copy_to_user(dirent, &tmp,
+				   offsetof(struct linux_dirent_stat, d_name)))
+			return -EFAULT;
+		if (__copy_to_user(dirent->d_name, de->name, de->namlen + 1))
+			return -EFAULT;
+		dirent = (void __user *)dirent + tmp.d_reclen;
+		de = next;
+	}
+	*pdirent = dirent;
+	return 0;
+}
+
+SYSCALL_DEFINE4(getdents_stat, unsigned int, fd,
+		struct linux_dirent_stat __user *, dirent, unsigned int, count,
+		unsigned int, flags)
+{
+	struct getdents_stat_callback buf;
+	struct file *file;
+	int may_search;
+	int error;
+
+	if (flags)
+		return -EINVAL;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		return -EFAULT;
+
+	file = fget(fd);
+	if (!file)
+		return -EBADF;
+
+	error = -ENOMEM;
+	buf.batch = (char *)__get_free_page(GFP_KERNEL);
+	if (!buf.batch)
+		goto out;
+	buf.count = count;
+
+	may_search = !inode_permission(file->f_path.dentry->d_inode, MAY_EXEC);
+	for (;;) {
+		buf.used = 0;
+		buf.nr = 0;
+		buf.batch_full = 0;
+		buf.error = 0;
+
+		error = vfs_readdir(file, filldir_stat, &buf);
+		if (error >= 0)
+			error = buf.error;
+		if (!buf.nr)
+			break;
+		error = dirstat_emit(file, &buf, may_search, &dirent);
+		if (error || !buf.batch_full)
+			break;
+	}
+	if (!error || (error != -EFAULT && buf.count != count))
+		error = count - buf.count;
+
+	free_page((unsigned long)buf.batch);
+out:
+	fput(file);
+	return error;
+}
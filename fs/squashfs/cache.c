@@ -56,6 +56,7 @@
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
@@ -66,6 +67,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 {
 	int i, n;
 	struct squashfs_cache_entry *entry;
+	struct squashfs_page_actor actor;
 
 	spin_lock(&cache->lock);
 
@@ -115,9 +117,10 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			entry->error = 0;
 			spin_unlock(&cache->lock);
 
-			entry->length = squashfs_read_data(sb, entry->data,
-				block, length, &entry->next_index,
-				cache->block_size, cache->pages);
+			squashfs_page_actor_init(&actor, entry->data,
+				cache->pages, cache->block_size);
+			entry->length = squashfs_read_data(sb, block, length,
+				&entry->next_index, &actor);
 
 			spin_lock(&cache->lock);
 
@@ -399,13 +402,16 @@ int squashfs_read_table(struct super_block *sb, void *buffer, u64 block,
 	int pages = (length + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 	int i, res;
 	void **data = kcalloc(pages, sizeof(void *), GFP_KERNEL);
+	struct squashfs_page_actor actor;
+
 	if (data == NULL)
 		return -ENOMEM;
 
 	for (i = 0; i < pages; i++, buffer += PAGE_CACHE_SIZE)
 		data[i] = buffer;
-	res = squashfs_read_data(sb, data, block, length |
-		SQUASHFS_COMPRESSED_BIT_BLOCK, NULL, length, pages);
+	squashfs_page_actor_init(&actor, data, pages, length);
+	res = squashfs_read_data(sb, block, length |
+		SQUASHFS_COMPRESSED_BIT_BLOCK, NULL, &actor);
 	kfree(data);
 	return res;
 }
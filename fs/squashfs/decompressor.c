@@ -22,7 +22,6 @@
  */
 
 #include <linux/types.h>
-#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
 
@@ -30,6 +29,7 @@
 #include "squashfs_fs_sb.h"
 #include "decompressor.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * This file (and decompressor.h) implements a decompressor framework for
@@ -81,6 +81,7 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
 	void *strm, *buffer = NULL;
+	struct squashfs_page_actor actor;
 	int length = 0;
 
 	/*
@@ -91,9 +92,9 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 		if (buffer == NULL)
 			return ERR_PTR(-ENOMEM);
 
-		length = squashfs_read_data(sb, &buffer,
-			sizeof(struct squashfs_super_block), 0, NULL,
-			PAGE_CACHE_SIZE, 1);
+		squashfs_page_actor_init(&actor, &buffer, 1, 0);
+		length = squashfs_read_data(sb,
+			sizeof(struct squashfs_super_block), 0, NULL, &actor);
 
 		if (length < 0) {
 			strm = ERR_PTR(length);
@@ -101,7 +102,7 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	strm = squashfs_decompressor_create(msblk, buffer, length);
 
 finished:
 	kfree(buffer);
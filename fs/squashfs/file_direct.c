@@ -0,0 +1,168 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2011
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * file_direct.c
+ */
+
+/*
+ * This file reads separately compressed datablocks of regular files
+ * straight into the page cache.  The page cache pages covering the block
+ * are grabbed and locked up front and handed to the decompressor through
+ * a page actor, avoiding the copy through the read_page squashfs_cache
+ * and the contention on its entries.  If any of those pages cannot be
+ * had (locked by someone else, or already up to date) the block is read
+ * through the read_page cache as before.
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+#include "page_actor.h"
+
+static int squashfs_read_cache(struct page *target_page, u64 block, int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_cache_entry *buffer = squashfs_get_datablock(inode->i_sb,
+						 block, bsize);
+	int res = buffer->error;
+
+	if (res)
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+	else
+		squashfs_copy_cache(target_page, buffer, buffer->length, 0);
+
+	squashfs_cache_put(buffer);
+	return res;
+}
+
+
+/* Read separately compressed datablock directly into page cache */
+int squashfs_readpage_block(struct page *target_page, u64 block, int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int i, n, pages, missing_pages, bytes, res;
+	struct squashfs_page_actor actor;
+	struct page **page;
+	void *pageaddr;
+
+	if (end_index > file_end)
+		end_index = file_end;
+
+	pages = end_index - start_index + 1;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		return squashfs_read_cache(target_page, block, bsize);
+
+	/* Try to grab all the pages covered by the Squashfs block */
+	for (missing_pages = 0, i = 0, n = start_index; i < pages; i++, n++) {
+		page[i] = (n == target_page->index) ? target_page :
+			grab_cache_page_nowait(target_page->mapping, n);
+
+		if (page[i] == NULL) {
+			missing_pages++;
+			continue;
+		}
+
+		if (page[i] != target_page && PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = NULL;
+			missing_pages++;
+		}
+	}
+
+	if (missing_pages) {
+		/*
+		 * Couldn't get one or more pages, this page has either
+		 * been VM reclaimed, but others are still in the page cache
+		 * and uptodate, or we're racing with another thread in
+		 * squashfs_readpage also trying to grab them.  Fall back to
+		 * using the read_page cache.
+		 */
+		for (i = 0; i < pages; i++) {
+			if (page[i] == NULL || page[i] == target_page)
+				continue;
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+		}
+		kfree(page);
+		return squashfs_read_cache(target_page, block, bsize);
+	}
+
+	/* Decompress directly into the page cache buffers */
+	squashfs_page_actor_init_special(&actor, page, pages, 0);
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, &actor);
+	if (res < 0)
+		goto mark_errored;
+
+	/* Zero whatever the block did not fill, normally the last page tail */
+	for (i = res >> PAGE_CACHE_SHIFT, bytes = res & (PAGE_CACHE_SIZE - 1);
+			i < pages; i++, bytes = 0) {
+		pageaddr = kmap_atomic(page[i], KM_USER0);
+		memset(pageaddr + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		kunmap_atomic(pageaddr, KM_USER0);
+	}
+
+	/* Mark pages as uptodate, unlock and release */
+	for (i = 0; i < pages; i++) {
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+
+	kfree(page);
+	return 0;
+
+mark_errored:
+	/*
+	 * Decompression failed, mark pages as errored.  Target_page is
+	 * dealt with by the caller
+	 */
+	for (i = 0; i < pages; i++) {
+		if (page[i] == target_page)
+			continue;
+		flush_dcache_page(page[i]);
+		SetPageError(page[i]);
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+
+	ERROR("Unable to read page, block %llx, size %x\n", block, bsize);
+	kfree(page);
+	return res;
+}
@@ -0,0 +1,66 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2011
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * page_actor.h
+ */
+
+#ifndef SQUASHFS_PAGE_ACTOR_H
+#define SQUASHFS_PAGE_ACTOR_H
+
+/*
+ * A page actor hands the decompressors the output buffer one
+ * PAGE_CACHE_SIZE chunk at a time, so the same decompressor code can
+ * fill either the kmalloced buffers of a squashfs_cache entry or the
+ * page cache pages of a file directly.
+ */
+struct squashfs_page_actor {
+	union {
+		void		**buffer;
+		struct page	**page;
+	};
+	void	*pageaddr;
+	void	*(*squashfs_first_page)(struct squashfs_page_actor *);
+	void	*(*squashfs_next_page)(struct squashfs_page_actor *);
+	void	(*squashfs_finish_page)(struct squashfs_page_actor *);
+	int	pages;
+	int	length;
+	int	next_page;
+};
+
+extern void squashfs_page_actor_init(struct squashfs_page_actor *, void **,
+	int, int);
+extern void squashfs_page_actor_init_special(struct squashfs_page_actor *,
+	struct page **, int, int);
+
+static inline void *squashfs_first_page(struct squashfs_page_actor *actor)
+{
+	return actor->squashfs_first_page(actor);
+}
+
+static inline void *squashfs_next_page(struct squashfs_page_actor *actor)
+{
+	return actor->squashfs_next_page(actor);
+}
+
+static inline void squashfs_finish_page(struct squashfs_page_actor *actor)
+{
+	actor->squashfs_finish_page(actor);
+}
+#endif
@@ -39,6 +39,9 @@
 #define YAFFS_GC_GOOD_ENOUGH 2
 #define YAFFS_GC_PASSIVE_THRESHOLD 4
 
+/* Cap on block age used in the cost-benefit score, keeps it within 32 bits */
+#define YAFFS_GC_MAX_AGE 0xffff
+
 #include "yaffs_ecc.h"
 
 /* Forward declarations */
@@ -1394,10 +1397,42 @@ static int yaffs_change_obj_name(struct yaffs_obj *obj,
  *   In Linux, the page cache provides read buffering and the short op cache 
  *   provides write buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   Caches in use are hashed by object and chunk id, and all caches sit on
+ *   an LRU list with the free ones at the front, so finding a chunk and
+ *   picking a victim do not depend on the number of caches.  Operations
+ *   on all of an object's chunks (flush, invalidate) still scan.
  */
 
+static struct list_head *yaffs_cache_bucket(struct yaffs_dev *dev,
+					    const struct yaffs_obj *obj,
+					    int chunk_id)
+{
+	u32 h = obj->obj_id * 0x9e370001 + chunk_id;
+
+	return &dev->cache_hash[(h ^ (h >> 16)) & dev->cache_hash_mask];
+}
+
+/* Give a free cache to a chunk. It becomes the most recently used. */
+static void yaffs_cache_attach(struct yaffs_dev *dev, struct yaffs_cache *cache,
+			       struct yaffs_obj *obj, int chunk_id)
+{
+	cache->object = obj;
+	cache->chunk_id = chunk_id;
+	cache->dirty = 0;
+	cache->locked = 0;
+	list_add(&cache->hash_link, yaffs_cache_bucket(dev, obj, chunk_id));
+	list_move_tail(&cache->lru_link, &dev->cache_lru);
+}
+
+/* Free a cache. It goes to the front of the LRU to be reused first. */
+static void yaffs_cache_release(struct yaffs_dev *dev, struct yaffs_cache *cache)
+{
+	cache->object = NULL;
+	cache->dirty = 0;
+	list_del_init(&cache->hash_link);
+	list_move(&cache->lru_link, &dev->cache_lru);
+}
+
 static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
@@ -1448,8 +1483,7 @@ static void yaffs_flush_file_cache(struct yaffs_obj *obj)
 						      cache->chunk_id,
 						      cache->data,
 						      cache->n_bytes, 1);
-				cache->dirty = 0;
-				cache->object = NULL;
+				yaffs_cache_release(dev, cache);
 			}
 
 		} while (cache && chunk_written > 0);
@@ -1493,18 +1527,18 @@ void yaffs_flush_whole_cache(struct yaffs_dev *dev)
 
 /* Grab us a cache chunk for use.
  * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+ * Then look for the least recently used one: if it is clean just take it,
+ * if it is dirty flush its object and look again.
  */
 static struct yaffs_cache *yaffs_grab_chunk_worker(struct yaffs_dev *dev)
 {
-	int i;
+	struct yaffs_cache *cache;
 
 	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (!dev->cache[i].object)
-				return &dev->cache[i];
-		}
+		cache = list_first_entry(&dev->cache_lru, struct yaffs_cache,
+					 lru_link);
+		if (!cache->object)
+			return cache;
 	}
 
 	return NULL;
@@ -1513,48 +1547,35 @@ static struct yaffs_cache *yaffs_grab_chunk_worker(struct yaffs_dev *dev)
 static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 {
 	struct yaffs_cache *cache;
-	struct yaffs_obj *the_obj;
-	int usage;
-	int i;
-	int pushout;
+	struct yaffs_cache *victim;
 
 	if (dev->param.n_caches > 0) {
-		/* Try find a non-dirty one... */
+		/* Try find a free one... */
 
 		cache = yaffs_grab_chunk_worker(dev);
 
 		if (!cache) {
-			/* They were all dirty, find the last recently used object and flush
-			 * its cache, then  find again.
-			 * NB what's here is not very accurate, we actually flush the object
-			 * the last recently used page.
+			/* They were all in use, take the least recently used
+			 * one that is not locked.
 			 */
-
-			/* With locking we can't assume we can use entry zero */
-
-			the_obj = NULL;
-			usage = -1;
-			cache = NULL;
-			pushout = -1;
-
-			for (i = 0; i < dev->param.n_caches; i++) {
-				if (dev->cache[i].object &&
-				    !dev->cache[i].locked &&
-				    (dev->cache[i].last_use < usage
-				     || !cache)) {
-					usage = dev->cache[i].last_use;
-					the_obj = dev->cache[i].object;
-					cache = &dev->cache[i];
-					pushout = i;
+			victim = NULL;
+			list_for_each_entry(cache, &dev->cache_lru, lru_link) {
+				if (!cache->locked) {
+					victim = cache;
+					break;
 				}
 			}
+			if (!victim)
+				return NULL;
 
-			if (!cache || cache->dirty) {
+			if (victim->dirty) {
 				/* Flush and try again */
-				yaffs_flush_file_cache(the_obj);
+				yaffs_flush_file_cache(victim->object);
 				cache = yaffs_grab_chunk_worker(dev);
+			} else {
+				yaffs_cache_release(dev, victim);
+				cache = victim;
 			}
-
 		}
 		return cache;
 	} else {
@@ -1563,42 +1584,49 @@ static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 }
 
 /* Find a cached chunk */
-static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
-						  int chunk_id)
+static struct yaffs_cache *yaffs_lookup_chunk_cache(const struct yaffs_obj *obj,
+						    int chunk_id)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
-	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object == obj &&
-			    dev->cache[i].chunk_id == chunk_id) {
-				dev->cache_hits++;
+	struct yaffs_cache *cache;
 
-				return &dev->cache[i];
-			}
+	if (dev->param.n_caches > 0) {
+		list_for_each_entry(cache,
+				    yaffs_cache_bucket(dev, obj, chunk_id),
+				    hash_link) {
+			if (cache->object == obj &&
+			    cache->chunk_id == chunk_id)
+				return cache;
 		}
 	}
 	return NULL;
 }
 
+/* Find a cached chunk for a read or write, counting hits and misses */
+static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
+						  int chunk_id)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+	struct yaffs_cache *cache;
+
+	if (dev->param.n_caches <= 0)
+		return NULL;
+
+	cache = yaffs_lookup_chunk_cache(obj, chunk_id);
+	if (cache)
+		dev->cache_hits++;
+	else
+		dev->cache_misses++;
+	return cache;
+}
+
 /* Mark the chunk for the least recently used algorithym */
 static void yaffs_use_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
 			    int is_write)
 {
 
 	if (dev->param.n_caches > 0) {
-		if (dev->cache_last_use < 0 || dev->cache_last_use > 100000000) {
-			/* Reset the cache usages */
-			int i;
-			for (i = 1; i < dev->param.n_caches; i++)
-				dev->cache[i].last_use = 0;
-
-			dev->cache_last_use = 0;
-		}
-
-		dev->cache_last_use++;
-
-		cache->last_use = dev->cache_last_use;
+		list_move_tail(&cache->lru_link, &dev->cache_lru);
 
 		if (is_write)
 			cache->dirty = 1;
@@ -1613,10 +1641,10 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
 {
 	if (object->my_dev->param.n_caches > 0) {
 		struct yaffs_cache *cache =
-		    yaffs_find_chunk_cache(object, chunk_id);
+		    yaffs_lookup_chunk_cache(object, chunk_id);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_cache_release(object->my_dev, cache);
 	}
 }
 
@@ -1632,7 +1660,7 @@ static void yaffs_invalidate_whole_cache(struct yaffs_obj *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->param.n_caches; i++) {
 			if (dev->cache[i].object == in)
-				dev->cache[i].object = NULL;
+				yaffs_cache_release(dev, &dev->cache[i]);
 		}
 	}
 }
@@ -2388,6 +2416,7 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 	if (block_no == dev->gc_dirtiest) {
 		dev->gc_dirtiest = 0;
 		dev->gc_pages_in_use = 0;
+		dev->gc_dirtiest_score = 0;
 	}
 
 	if (!bi->needs_retiring) {
@@ -2715,9 +2744,35 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	return ret_val;
 }
 
+/*
+ * Cost-benefit score of collecting a block, as in log-structured file
+ * systems: the space reclaimed, weighted by how long the block has been
+ * stable, over the cost of reading the block and copying its live
+ * chunks.  Old, mostly-dead blocks score highest; a young block that is
+ * still being overwritten is left to die off further.
+ * yaffs1 has no block sequence numbers, so there every block has the
+ * same age and this reduces to picking the dirtiest block.
+ */
+static unsigned yaffs_gc_score(struct yaffs_dev *dev,
+			       struct yaffs_block_info *bi, int pages_used)
+{
+	unsigned age = 1;
+
+	if (dev->param.is_yaffs2 && dev->seq_number > bi->seq_number) {
+		age += dev->seq_number - bi->seq_number;
+		if (age > YAFFS_GC_MAX_AGE)
+			age = YAFFS_GC_MAX_AGE;
+	}
+
+	return (dev->param.chunks_per_block - pages_used) * age /
+	    (dev->param.chunks_per_block + pages_used);
+}
+
 /*
  * FindBlockForgarbageCollection is used to select the dirtiest block (or close enough)
  * for garbage collection.
+ * Aggressive gc wants space now and takes the dirtiest block; otherwise the
+ * block with the best cost-benefit score among the blocks inspected wins.
  */
 
 static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
@@ -2771,6 +2826,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 	if (!selected) {
 		int pages_used;
+		unsigned score;
 		int n_blocks =
 		    dev->internal_end_block - dev->internal_start_block + 1;
 		if (aggressive) {
@@ -2812,13 +2868,18 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 			pages_used = bi->pages_in_use - bi->soft_del_pages;
 
-			if (bi->block_state == YAFFS_BLOCK_STATE_FULL &&
-			    pages_used < dev->param.chunks_per_block &&
-			    (dev->gc_dirtiest < 1
-			     || pages_used < dev->gc_pages_in_use)
-			    && yaffs_block_ok_for_gc(dev, bi)) {
+			if (bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+			    pages_used >= dev->param.chunks_per_block ||
+			    !yaffs_block_ok_for_gc(dev, bi))
+				continue;
+
+			score = yaffs_gc_score(dev, bi, pages_used);
+			if (dev->gc_dirtiest < 1 ||
+			    (aggressive && pages_used < dev->gc_pages_in_use) ||
+			    (!aggressive && score > dev->gc_dirtiest_score)) {
 				dev->gc_dirtiest = dev->gc_block_finder;
 				dev->gc_pages_in_use = pages_used;
+				dev->gc_dirtiest_score = score;
 			}
 		}
 
@@ -2859,6 +2920,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 		dev->gc_dirtiest = 0;
 		dev->gc_pages_in_use = 0;
+		dev->gc_dirtiest_score = 0;
 		dev->gc_not_done = 0;
 		if (dev->refresh_skip > 0)
 			dev->refresh_skip--;
@@ -2950,6 +3012,8 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 		}
 
 		if (dev->gc_block > 0) {
+			u32 copies_before = dev->n_gc_copies;
+
 			dev->all_gcs++;
 			if (!aggressive)
 				dev->passive_gc_count++;
@@ -2959,6 +3023,13 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 				dev->n_erased_blocks, aggressive);
 
 			gc_ok = yaffs_gc_block(dev, dev->gc_block, aggressive);
+
+			/* The writer is waiting on this collection */
+			if (!background) {
+				dev->gc_stalls++;
+				dev->gc_stall_copies +=
+				    dev->n_gc_copies - copies_before;
+			}
 		}
 
 		if (dev->n_erased_blocks < (dev->param.n_reserved_blocks)
@@ -2974,19 +3045,37 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 	return aggressive ? gc_ok : YAFFS_OK;
 }
 
+/*
+ * yaffs_gc_target()
+ * The number of erased blocks background gc tries to keep in hand, so
+ * that writers rarely have to collect garbage themselves.
+ */
+int yaffs_gc_target(struct yaffs_dev *dev)
+{
+	if (dev->param.gc_target_erased > dev->param.n_reserved_blocks)
+		return dev->param.gc_target_erased;
+	return dev->param.n_reserved_blocks * 2;
+}
+
 /*
  * yaffs_bg_gc()
  * Garbage collects. Intended to be called from a background thread.
- * Returns non-zero if at least half the free chunks are erased.
+ * Does a bounded amount of work per call so that the caller can drop its
+ * locks in between; call again while it returns zero.
+ * Returns non-zero if at least half the free chunks are erased and the
+ * erased block target is met.
  */
 int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency)
 {
-	int erased_chunks = dev->n_erased_blocks * dev->param.chunks_per_block;
+	int erased_chunks;
 
 	yaffs_trace(YAFFS_TRACE_BACKGROUND, "Background gc %u", urgency);
 
 	yaffs_check_gc(dev, 1);
-	return erased_chunks > dev->n_free_chunks / 2;
+
+	erased_chunks = dev->n_erased_blocks * dev->param.chunks_per_block;
+	return erased_chunks > dev->n_free_chunks / 2 &&
+	    dev->n_erased_blocks >= yaffs_gc_target(dev);
 }
 
 /*-------------------- Data file manipulation -----------------*/
@@ -3581,10 +3670,7 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 				if (!cache) {
 					cache =
 					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					yaffs_cache_attach(dev, cache, in, chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
 					cache->n_bytes = 0;
@@ -3707,10 +3793,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 * buffer, loff_t offset,
 				if (!cache
 				    && yaffs_check_alloc_available(dev, 1)) {
 					cache = yaffs_grab_chunk_cache(dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					yaffs_cache_attach(dev, cache, in, chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
 				} else if (cache &&
@@ -4916,6 +4999,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->passive_gc_count = 0;
 	dev->oldest_dirty_gc_count = 0;
 	dev->bg_gcs = 0;
+	dev->gc_stalls = 0;
+	dev->gc_stall_copies = 0;
 	dev->gc_block_finder = 0;
 	dev->buffered_block = -1;
 	dev->doing_buffered_block_rewrite = 0;
@@ -4944,33 +5029,53 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	if (!init_failed && dev->param.n_caches > 0) {
 		int i;
 		void *buf;
-		int cache_bytes =
-		    dev->param.n_caches * sizeof(struct yaffs_cache);
+		int cache_bytes;
+		u32 n_buckets;
 
 		if (dev->param.n_caches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->param.n_caches = YAFFS_MAX_SHORT_OP_CACHES;
+		cache_bytes = dev->param.n_caches * sizeof(struct yaffs_cache);
 
+		/* If the first allocation strategy fails, try the alternate one */
 		dev->cache = kmalloc(cache_bytes, GFP_NOFS);
+		dev->cache_alt = 0;
+		if (!dev->cache) {
+			dev->cache = vmalloc(cache_bytes);
+			dev->cache_alt = 1;
+		}
+
+		/* About one hash bucket per cache */
+		n_buckets = roundup_pow_of_two(dev->param.n_caches);
+		dev->cache_hash_mask = n_buckets - 1;
+		dev->cache_hash =
+		    kmalloc(n_buckets * sizeof(struct list_head), GFP_NOFS);
+		if (dev->cache_hash)
+			for (i = 0; i < n_buckets; i++)
+				INIT_LIST_HEAD(&dev->cache_hash[i]);
+		INIT_LIST_HEAD(&dev->cache_lru);
 
 		buf = (u8 *) dev->cache;
+		if (!dev->cache_hash)
+			buf = NULL;
 
 		if (dev->cache)
 			memset(dev->cache, 0, cache_bytes);
 
 		for (i = 0; i < dev->param.n_caches && buf; i++) {
 			dev->cache[i].object = NULL;
-			dev->cache[i].last_use = 0;
 			dev->cache[i].dirty = 0;
+			INIT_LIST_HEAD(&dev->cache[i].hash_link);
+			list_add_tail(&dev->cache[i].lru_link,
+				      &dev->cache_lru);
 			dev->cache[i].data = buf =
 			    kmalloc(dev->param.total_bytes_per_chunk, GFP_NOFS);
 		}
 		if (!buf)
 			init_failed = 1;
-
-		dev->cache_last_use = 0;
 	}
 
 	dev->cache_hits = 0;
+	dev->cache_misses = 0;
 
 	if (!init_failed) {
 		dev->gc_cleanup_list =
@@ -5084,8 +5189,13 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 				dev->cache[i].data = NULL;
 			}
 
-			kfree(dev->cache);
+			if (dev->cache_alt)
+				vfree(dev->cache);
+			else
+				kfree(dev->cache);
 			dev->cache = NULL;
+			kfree(dev->cache_hash);
+			dev->cache_hash = NULL;
 		}
 
 		kfree(dev->gc_cleanup_list);
@@ -83,7 +83,7 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	1024
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -110,11 +110,14 @@
 struct yaffs_cache {
 	struct yaffs_obj *object;
 	int chunk_id;
-	int last_use;
 	int dirty;
 	int n_bytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
 	u8 *data;
+	struct list_head hash_link;	/* On dev->cache_hash while in use */
+	struct list_head lru_link;	/* On dev->cache_lru, free ones first,
+					 * then least recently used first.
+					 */
 };
 
 /* Tags structures in RAM
@@ -518,6 +521,11 @@ struct yaffs_param {
 
 	int refresh_period;	/* How often we should check to do a block refresh */
 
+	int gc_target_erased;	/* Erased blocks background gc tries to keep
+				 * in hand. If <= n_reserved_blocks, twice
+				 * n_reserved_blocks is used.
+				 */
+
 	/* Checkpoint control. Can be set before or after initialisation */
 	u8 skip_checkpt_rd;
 	u8 skip_checkpt_wr;
@@ -667,6 +675,7 @@ struct yaffs_dev {
 	unsigned gc_block_finder;
 	unsigned gc_dirtiest;
 	unsigned gc_pages_in_use;
+	unsigned gc_dirtiest_score;	/* cost-benefit score of gc_dirtiest */
 	unsigned gc_not_done;
 	unsigned gc_block;
 	unsigned gc_chunk;
@@ -685,7 +694,10 @@ struct yaffs_dev {
 	int doing_buffered_block_rewrite;
 
 	struct yaffs_cache *cache;
-	int cache_last_use;
+	struct list_head *cache_hash;	/* Caches in use, by object and chunk */
+	u32 cache_hash_mask;
+	struct list_head cache_lru;
+	unsigned cache_alt:1;	/* was allocated using alternative strategy */
 
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted files live. */
@@ -724,6 +736,8 @@ struct yaffs_dev {
 	u32 oldest_dirty_gc_count;
 	u32 n_gc_blocks;
 	u32 bg_gcs;
+	u32 gc_stalls;		/* Writes that had to collect garbage inline */
+	u32 gc_stall_copies;	/* Chunks copied by those writes */
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
 	u32 n_ecc_fixed;
@@ -734,6 +748,7 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 cache_misses;
 
 };
 
@@ -857,6 +872,7 @@ void yaffs_handle_defered_free(struct yaffs_obj *obj);
 void yaffs_update_dirty_dirs(struct yaffs_dev *dev);
 
 int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency);
+int yaffs_gc_target(struct yaffs_dev *dev);
 
 /* Debug dump  */
 int yaffs_dump_obj(struct yaffs_obj *obj);
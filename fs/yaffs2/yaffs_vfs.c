@@ -1559,6 +1559,10 @@ static unsigned yaffs_bg_gc_urgency(struct yaffs_dev *dev)
 		return 0;
 	else if (scattered < (dev->param.chunks_per_block * 2))
 		return 0;
+	else if (dev->n_erased_blocks < yaffs_gc_target(dev) / 2)
+		return 2;
+	else if (dev->n_erased_blocks < yaffs_gc_target(dev))
+		return 1;
 	else if (erased_chunks > dev->n_free_chunks / 2)
 		return 0;
 	else if (erased_chunks > dev->n_free_chunks / 4)
@@ -1614,6 +1618,35 @@ void yaffs_background_waker(unsigned long data)
 	wake_up_process((struct task_struct *)data);
 }
 
+/*
+ * Background gc works in slices of at most a few chunk copies and lets go
+ * of the gross lock between slices, so writers queue behind one slice
+ * rather than behind a whole run of collection.  When urgent it keeps
+ * going, up to YAFFS_BG_GC_SLICES slices per wakeup, until the erased
+ * block target is met.
+ */
+#define YAFFS_BG_GC_SLICES 32
+
+static void yaffs_bg_gc_run(struct yaffs_dev *dev)
+{
+	unsigned urgency = yaffs_bg_gc_urgency(dev);
+	int slices = 0;
+
+	while (!yaffs_bg_gc(dev, urgency) && urgency > 0 &&
+	       ++slices < YAFFS_BG_GC_SLICES) {
+		yaffs_gross_unlock(dev);
+		cond_resched();
+		if (kthread_should_stop()) {
+			yaffs_gross_lock(dev);
+			break;
+		}
+		yaffs_gross_lock(dev);
+		if (dev->is_checkpointed || !yaffs_bg_enable)
+			break;
+		urgency = yaffs_bg_gc_urgency(dev);
+	}
+}
+
 static int yaffs_bg_thread_fn(void *data)
 {
 	struct yaffs_dev *dev = (struct yaffs_dev *)data;
@@ -1624,7 +1657,6 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long expires;
 	unsigned int urgency;
 
-	int gc_result;
 	struct timer_list timer;
 
 	yaffs_trace(YAFFS_TRACE_BACKGROUND,
@@ -1651,8 +1683,9 @@ static int yaffs_bg_thread_fn(void *data)
 
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
+				yaffs_bg_gc_run(dev);
 				urgency = yaffs_bg_gc_urgency(dev);
-				gc_result = yaffs_bg_gc(dev, urgency);
+				now = jiffies;
 				if (urgency > 1)
 					next_gc = now + HZ / 20 + 1;
 				else if (urgency > 0)
@@ -1763,6 +1796,8 @@ struct yaffs_options {
 	int lazy_loading_overridden;
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
+	int gc_target;
+	int n_caches;
 };
 
 #define MAX_OPT_LEN 30
@@ -1812,6 +1847,9 @@ static int yaffs_parse_options(struct yaffs_options *options,
 			options->empty_lost_and_found_overridden = 1;
 		} else if (!strcmp(cur_opt, "no-cache")) {
 			options->no_cache = 1;
+		} else if (!strncmp(cur_opt, "cache-chunks=", 13)) {
+			options->n_caches =
+			    simple_strtoul(cur_opt + 13, NULL, 0);
 		} else if (!strcmp(cur_opt, "no-checkpoint-read")) {
 			options->skip_checkpoint_read = 1;
 		} else if (!strcmp(cur_opt, "no-checkpoint-write")) {
@@ -1819,6 +1857,9 @@ static int yaffs_parse_options(struct yaffs_options *options,
 		} else if (!strcmp(cur_opt, "no-checkpoint")) {
 			options->skip_checkpoint_read = 1;
 			options->skip_checkpoint_write = 1;
+		} else if (!strncmp(cur_opt, "gc-target=", 10)) {
+			options->gc_target =
+			    simple_strtoul(cur_opt + 10, NULL, 0);
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 			       cur_opt);
@@ -2214,7 +2255,9 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->chunks_per_block = YAFFS_CHUNKS_PER_BLOCK;
 	param->total_bytes_per_chunk = YAFFS_BYTES_PER_CHUNK;
 	param->n_reserved_blocks = 5;
-	param->n_caches = (options.no_cache) ? 0 : 10;
+	param->gc_target_erased = options.gc_target;
+	param->n_caches = (options.no_cache) ? 0 :
+	    (options.n_caches > 0) ? options.n_caches : 10;
 	param->inband_tags = options.inband_tags;
 
 #ifdef CONFIG_YAFFS_DISABLE_LAZY_LOAD
@@ -2440,10 +2483,37 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
 			param->always_check_erased);
+	buf += sprintf(buf, "gc_target_erased...... %d\n",
+			yaffs_gc_target(dev));
 
 	return buf;
 }
 
+/*
+ * Write amplification: chunks written to flash per chunk written on
+ * behalf of the user, i.e. page writes over page writes less gc copies.
+ */
+static char *yaffs_dump_write_amp(char *buf, struct yaffs_dev *dev)
+{
+	u32 user_writes = dev->n_page_writes - dev->n_gc_copies;
+	u32 wa = 100;
+
+	if (user_writes)
+		wa = div_u64((u64)dev->n_page_writes * 100, user_writes);
+	return buf + sprintf(buf, "write_amplification... %u.%02u\n",
+			     wa / 100, wa % 100);
+}
+
+static char *yaffs_dump_cache_hit_rate(char *buf, struct yaffs_dev *dev)
+{
+	u64 lookups = (u64)dev->cache_hits + dev->cache_misses;
+	u32 rate = 0;
+
+	if (lookups)
+		rate = div64_u64((u64)dev->cache_hits * 100, lookups);
+	return buf + sprintf(buf, "cache_hit_rate........ %u%%\n", rate);
+}
+
 static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 {
 	buf +=
@@ -2472,6 +2542,10 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf += sprintf(buf, "gc_stalls............. %u\n", dev->gc_stalls);
+	buf +=
+	    sprintf(buf, "gc_stall_copies....... %u\n", dev->gc_stall_copies);
+	buf = yaffs_dump_write_amp(buf, dev);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
@@ -2484,6 +2558,8 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
 		    dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits............ %u\n", dev->cache_hits);
+	buf += sprintf(buf, "cache_misses.......... %u\n", dev->cache_misses);
+	buf = yaffs_dump_cache_hit_rate(buf, dev);
 	buf +=
 	    sprintf(buf, "n_deleted_files....... %u\n", dev->n_deleted_files);
 	buf +=
@@ -2,6 +2,7 @@
 #define __LINUX__AIO_H
 
 #include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/workqueue.h>
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
@@ -13,6 +14,7 @@
 #define AIO_KIOGRP_NR_ATOMIC	8
 
 struct kioctx;
+struct cred;
 
 /* Notes on cancelling a kiocb:
  *	If a kiocb is cancelled, aio_complete may return 0 to indicate 
@@ -123,6 +125,10 @@ struct kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/* Buffered i/o handed off to the worker pool */
+	struct work_struct	ki_work;
+	const struct cred	*ki_cred;
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -197,6 +203,13 @@ struct kioctx {
 
 	struct aio_ring_info	ring_info;
 
+	/* Submission ring, see io_sq_setup() */
+	struct aio_sq_ring __user *sq_ring;
+	unsigned		sq_nr;
+	unsigned		sq_head;	/* trusted copy */
+	bool			sq_compat;
+	struct mutex		sq_mutex;
+
 	struct delayed_work	wq;
 
 	struct rcu_head		rcu_head;
@@ -214,6 +227,9 @@ struct mm_struct;
 extern void exit_aio(struct mm_struct *mm);
 extern long do_io_submit(aio_context_t ctx_id, long nr,
 			 struct iocb __user *__user *iocbpp, bool compat);
+extern long do_io_sq_setup(aio_context_t ctx_id,
+			   struct aio_sq_ring __user *ring, unsigned nr,
+			   bool compat);
 #else
 static inline ssize_t wait_on_sync_kiocb(struct kiocb *iocb) { return 0; }
 static inline int aio_put_req(struct kiocb *iocb) { return 0; }
@@ -224,6 +240,9 @@ static inline void exit_aio(struct mm_struct *mm) { }
 static inline long do_io_submit(aio_context_t ctx_id, long nr,
 				struct iocb __user * __user *iocbpp,
 				bool compat) { return 0; }
+static inline long do_io_sq_setup(aio_context_t ctx_id,
+				  struct aio_sq_ring __user *ring,
+				  unsigned nr, bool compat) { return 0; }
 #endif /* CONFIG_AIO */
 
 static inline struct kiocb *list_kiocb(struct list_head *h)
@@ -234,5 +253,6 @@ static inline struct kiocb *list_kiocb(struct list_head *h)
 /* for sysctl: */
 extern unsigned long aio_nr;
 extern unsigned long aio_max_nr;
+extern int aio_buffered_async;
 
 #endif /* __LINUX__AIO_H */
@@ -104,6 +104,21 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Submission ring registered with io_sq_setup().  Userspace stores
+ * iocb pointers at iocbs[tail % nr] and then advances tail; the
+ * kernel submits the entries up to tail on io_sq_enter() and on
+ * io_getevents(), and advances head past them.  head and tail are
+ * free running counters.  A zero entry is skipped, which is how an
+ * iocb that failed to submit can be dropped from the ring.
+ */
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by userspace */
+	__u32	reserved[2];
+	__u64	iocbs[0];	/* struct iocb __user * */
+};
+
 #undef IFBIG
 #undef IFLITTLE
 
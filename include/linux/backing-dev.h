@@ -40,11 +40,32 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_DIRTIED,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/*
+ * Writeback work priority classes, highest first.  The flusher thread
+ * always runs work from the highest non-empty class, and running work
+ * yields to newly queued work of a higher class between chunks.
+ */
+enum wb_class {
+	WB_CLASS_SYNC,		/* WB_SYNC_ALL, or work a caller waits on */
+	WB_CLASS_ASYNC,		/* explicitly requested WB_SYNC_NONE writeback */
+	WB_CLASS_BACKGROUND,	/* background and periodic (kupdate) flushing */
+	NR_WB_CLASSES
+};
+
+struct wb_class_stat {
+	unsigned long nr_works;		/* works completed */
+	unsigned long nr_preempted;	/* times yielded to a higher class */
+	unsigned long total_latency;	/* queueing to completion, jiffies */
+	unsigned long max_latency;
+};
+
 struct bdi_writeback {
 	struct backing_dev_info *bdi;	/* our parent bdi */
 	unsigned int nr;
@@ -71,6 +92,21 @@ struct backing_dev_info {
 
 	struct percpu_counter bdi_stat[NR_BDI_STAT_ITEMS];
 
+	unsigned long bw_time_stamp;	/* last time write bw is updated */
+	unsigned long dirtied_stamp;	/* BDI_DIRTIED at bw_time_stamp */
+	unsigned long written_stamp;	/* BDI_WRITTEN at bw_time_stamp */
+	unsigned long write_bandwidth;	/* the estimated write bandwidth */
+	unsigned long avg_write_bandwidth; /* further smoothed write bw */
+
+	/*
+	 * The base dirty throttle rate, re-calculated every 200ms.  All the
+	 * bdi tasks' dirty rate will be curbed under it.  @dirty_ratelimit
+	 * tracks the estimated @balanced_dirty_ratelimit in small steps and
+	 * is much more smooth/stable than the latter.
+	 */
+	unsigned long dirty_ratelimit;
+	unsigned long balanced_dirty_ratelimit;
+
 	struct prop_local_percpu completions;
 	int dirty_exceeded;
 
@@ -78,9 +114,10 @@ struct backing_dev_info {
 	unsigned int max_ratio, max_prop_frac;
 
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
-	spinlock_t wb_lock;	  /* protects work_list */
+	spinlock_t wb_lock;	  /* protects work_list and wb_class_stat */
 
-	struct list_head work_list;
+	struct list_head work_list[NR_WB_CLASSES];
+	struct wb_class_stat wb_class_stat[NR_WB_CLASSES];
 
 	struct device *dev;
 
@@ -111,6 +148,26 @@ extern spinlock_t bdi_lock;
 extern struct list_head bdi_list;
 extern struct list_head bdi_pending_list;
 
+/*
+ * Is there queued work of a higher priority than @class?  Pass
+ * NR_WB_CLASSES to check for any queued work.
+ */
+static inline bool bdi_has_work_above(struct backing_dev_info *bdi,
+				      enum wb_class class)
+{
+	int i;
+
+	for (i = 0; i < class; i++)
+		if (!list_empty(&bdi->work_list[i]))
+			return true;
+	return false;
+}
+
+static inline bool bdi_has_work(struct backing_dev_info *bdi)
+{
+	return bdi_has_work_above(bdi, NR_WB_CLASSES);
+}
+
 static inline int wb_has_dirty_io(struct bdi_writeback *wb)
 {
 	return !list_empty(&wb->b_dirty) ||
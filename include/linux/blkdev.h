@@ -126,6 +126,9 @@ struct request {
 #ifdef CONFIG_BLK_CGROUP
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+#ifdef CONFIG_BLK_DEV_THROTTLING
+	struct throtl_grp *throtl_grp;	/* for latency target accounting */
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -1180,6 +1183,10 @@ static inline uint64_t rq_io_start_time_ns(struct request *req)
 extern int blk_throtl_init(struct request_queue *q);
 extern void blk_throtl_exit(struct request_queue *q);
 extern int blk_throtl_bio(struct request_queue *q, struct bio **bio);
+extern void blk_throtl_rq_init(struct request_queue *q, struct request *rq,
+			       struct bio *bio);
+extern void blk_throtl_rq_done(struct request *rq);
+extern void blk_throtl_rq_put(struct request *rq);
 #else /* CONFIG_BLK_DEV_THROTTLING */
 static inline int blk_throtl_bio(struct request_queue *q, struct bio **bio)
 {
@@ -1188,6 +1195,10 @@ static inline int blk_throtl_bio(struct request_queue *q, struct bio **bio)
 
 static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline int blk_throtl_exit(struct request_queue *q) { return 0; }
+static inline void blk_throtl_rq_init(struct request_queue *q,
+				      struct request *rq, struct bio *bio) {}
+static inline void blk_throtl_rq_done(struct request *rq) {}
+static inline void blk_throtl_rq_put(struct request *rq) {}
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
 #define MODULE_ALIAS_BLOCKDEV(major,minor) \
@@ -0,0 +1,25 @@
+#ifndef _LINUX_DIRENT_STAT_H
+#define _LINUX_DIRENT_STAT_H
+
+#include <linux/types.h>
+
+/*
+ * Record returned by getdents_stat(): a dirent plus lstat()-like
+ * attributes.  Records are 8-byte aligned; d_reclen gives the offset of
+ * the next one.
+ */
+struct linux_dirent_stat {
+	__u64		d_ino;
+	__s64		d_off;
+	__u64		d_size;
+	__s64		d_mtime;
+	__u32		d_mtime_nsec;
+	__u32		d_mode;		/* 0 if the attributes are unavailable */
+	__u32		d_uid;
+	__u32		d_gid;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[0];
+};
+
+#endif /* _LINUX_DIRENT_STAT_H */
@@ -25,6 +25,7 @@ typedef void (elevator_completed_req_fn) (struct request_queue *, struct request
 typedef int (elevator_may_queue_fn) (struct request_queue *, int);
 
 typedef int (elevator_set_req_fn) (struct request_queue *, struct request *, gfp_t);
+typedef int (elevator_set_req_locked_fn) (struct request_queue *, struct request *);
 typedef void (elevator_put_req_fn) (struct request *);
 typedef void (elevator_activate_req_fn) (struct request_queue *, struct request *);
 typedef void (elevator_deactivate_req_fn) (struct request_queue *, struct request *);
@@ -51,6 +52,7 @@ struct elevator_ops
 	elevator_request_list_fn *elevator_latter_req_fn;
 
 	elevator_set_req_fn *elevator_set_req_fn;
+	elevator_set_req_locked_fn *elevator_set_req_locked_fn;
 	elevator_put_req_fn *elevator_put_req_fn;
 
 	elevator_may_queue_fn *elevator_may_queue_fn;
@@ -117,6 +119,7 @@ extern int elv_may_queue(struct request_queue *, int);
 extern void elv_abort_queue(struct request_queue *);
 extern void elv_completed_request(struct request_queue *, struct request *);
 extern int elv_set_request(struct request_queue *, struct request *, gfp_t);
+extern int elv_set_request_locked(struct request_queue *, struct request *);
 extern void elv_put_request(struct request_queue *, struct request *);
 extern void elv_drain_elevator(struct request_queue *);
 
@@ -26,6 +26,13 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Request exclusive wakeups for the target file descriptor: when several
+ * epoll instances watch the same file with this flag set, an event wakes
+ * up only one of them instead of all of them.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
 
@@ -49,6 +56,20 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * One operation of an epoll_ctl_batch() vector. @op, @fd, @events and
+ * @data have the same meaning as the epoll_ctl() arguments; @result
+ * receives the epoll_ctl() return value for this entry. The layout is
+ * the same for 32bit and 64bit callers.
+ */
+struct epoll_ctl_cmd {
+	__u32 op;
+	__s32 fd;
+	__u32 events;
+	__s32 result;
+	__u64 data;
+};
+
 #ifdef __KERNEL__
 
 /* Forward declarations to avoid compiler errors */
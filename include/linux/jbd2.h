@@ -49,6 +49,12 @@
  */
 #define JBD2_DEFAULT_MAX_COMMIT_AGE 5
 
+/*
+ * The default delay between background checkpoint passes, in
+ * milliseconds.
+ */
+#define JBD2_DEFAULT_CHECKPOINT_DELAY 10
+
 #ifdef CONFIG_JBD2_DEBUG
 /*
  * Define JBD2_EXPENSIVE_CHECKING to enable more expensive internal
@@ -130,6 +136,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -241,7 +248,9 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+/* 0x0054 */
+	__u32	s_padding[43];
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +272,35 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * The fast commit area described below is local to this tree and has
+ * nothing in common with upstream's fast commit format, so it takes a
+ * bit well clear of the ones allocated upstream.
+ */
+#define JBD2_FEATURE_INCOMPAT_LOCAL_FC		0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_LOCAL_FC)
+
+/*
+ * Fast commit blocks live in a fixed area at the end of the journal,
+ * outside of the circular log.  Each one carries an opaque payload
+ * written by the filesystem, which only applies on top of the
+ * transaction whose ID is in fc_header.h_sequence: once a later
+ * transaction has committed, the block is stale.
+ */
+typedef struct jbd2_fc_header_s
+{
+	journal_header_t fc_header;
+	__be32		fc_index;	/* position in the fast commit area */
+	__be32		fc_len;		/* payload length in bytes */
+	__be32		fc_crc32;	/* crc32_be of the above and payload */
+} jbd2_fc_header_t;
 
 #ifdef __KERNEL__
 
@@ -679,9 +710,16 @@ struct transaction_run_stats_s {
 	__u32			rs_blocks_logged;
 };
 
+/*
+ * fsync latency histogram: bucket i counts the fsyncs which took less
+ * than 2^(i+1) microseconds (and at least 2^i, except for bucket 0).
+ */
+#define JBD2_FSYNC_HIST_BUCKETS	24
+
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	struct transaction_run_stats_s run;
+	unsigned long		ts_fsync_hist[JBD2_FSYNC_HIST_BUCKETS];
 };
 
 static inline unsigned long
@@ -743,6 +781,16 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  *     commit
  * @j_uuid: Uuid of client object.
  * @j_task: Pointer to the current commit thread for this journal
+ * @j_checkpoint_task: Pointer to the background checkpoint thread for this
+ *     journal
+ * @j_checkpoint_delay: Pause between two background checkpoint passes while
+ *     the log is not short of space, in jiffies
+ * @j_fc_first: First block of the fast commit area
+ * @j_fc_blocks: Number of blocks in the fast commit area
+ * @j_fc_off: Next block to use in the fast commit area
+ * @j_fc_base: Transaction the fast commits in the area apply on top of
+ * @j_fc_replay_tid: Last transaction found by recovery
+ * @j_fc_mutex: Serialises fast commits
  * @j_max_transaction_buffers:  Maximum number of metadata buffers to allow in a
  *     single compound commit transaction
  * @j_commit_interval: What is the maximum transaction lifetime before we begin
@@ -932,6 +980,30 @@ struct journal_s
 	/* Pointer to the current commit thread for this journal */
 	struct task_struct	*j_task;
 
+	/* Pointer to the background checkpoint thread for this journal */
+	struct task_struct	*j_checkpoint_task;
+
+	/*
+	 * How long the checkpoint thread pauses between two passes while
+	 * the log still has room for a transaction, in jiffies.
+	 */
+	unsigned long		j_checkpoint_delay;
+
+	/*
+	 * Fast commit area, [j_fc_first, j_fc_first + j_fc_blocks), just
+	 * after j_last.  j_fc_blocks is zero if the journal has none.
+	 */
+	unsigned long		j_fc_first;
+	unsigned int		j_fc_blocks;
+
+	/* Fast commit area fill state [j_fc_mutex] */
+	unsigned int		j_fc_off;
+	tid_t			j_fc_base;
+	struct mutex		j_fc_mutex;
+
+	/* Fast commits on top of this transaction must be replayed */
+	tid_t			j_fc_replay_tid;
+
 	/*
 	 * Maximum number of metadata buffers to allow in a single compound
 	 * commit transaction
@@ -1013,6 +1085,10 @@ struct journal_s
 #define JBD2_ABORT_ON_SYNCDATA_ERR	0x040	/* Abort the journal on file
 						 * data write error in ordered
 						 * mode */
+#define JBD2_CLEAN_CHECKPOINT	0x080	/* A commit finished, the checkpoint
+					 * thread should clean the lists */
+#define JBD2_FC_REPLAY	0x100	/* Recovery ran, the fast commit area
+				 * may hold blocks to replay */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1228,6 +1304,16 @@ int jbd2_journal_start_commit(journal_t *journal, tid_t *tid);
 int jbd2_journal_force_commit_nested(journal_t *journal);
 int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
+int jbd2_checkpoint_thread(void *arg);
+void jbd2_log_wake_checkpoint(journal_t *journal);
+void jbd2_journal_account_fsync(journal_t *journal, ktime_t start);
+
+/* Fast commits (journal.c) */
+extern int jbd2_fc_init(journal_t *journal, unsigned int nblocks);
+extern int jbd2_fc_commit(journal_t *journal, const void *data, int len);
+extern int jbd2_fc_replay(journal_t *journal,
+			  int (*fn)(journal_t *, const void *, int, void *),
+			  void *priv);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
@@ -1302,6 +1388,17 @@ static inline int jbd_space_needed(journal_t *journal)
 	return nblocks;
 }
 
+/*
+ * The background checkpoint thread starts working once the free log
+ * space drops below twice what a new transaction needs, so that handle
+ * starts normally never have to checkpoint synchronously.
+ */
+static inline int jbd2_log_need_checkpoint(journal_t *journal)
+{
+	return journal->j_checkpoint_transactions &&
+		__jbd2_log_space_left(journal) < 2 * jbd_space_needed(journal);
+}
+
 /*
  * Definitions which augment the buffer_head layer
  */
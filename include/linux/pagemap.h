@@ -439,12 +439,18 @@ static inline int fault_in_pages_readable(const char __user *uaddr, int size)
 	return ret;
 }
 
+struct pagevec;
+
 int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
+int add_to_page_cache_lru_batch(struct pagevec *pvec,
+				struct address_space *mapping, gfp_t gfp_mask);
 extern void delete_from_page_cache(struct page *page);
 extern void __delete_from_page_cache(struct page *page);
+extern void delete_from_page_cache_batch(struct address_space *mapping,
+					 struct pagevec *pvec);
 int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask);
 
 /*
@@ -99,6 +99,7 @@ do {									\
  * radix_tree_tag_get
  * radix_tree_gang_lookup
  * radix_tree_gang_lookup_slot
+ * radix_tree_gang_lookup_contig_slot
  * radix_tree_gang_lookup_tag
  * radix_tree_gang_lookup_tag_slot
  * radix_tree_tagged
@@ -197,6 +198,10 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 unsigned int
 radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 			unsigned long first_index, unsigned int max_items);
+unsigned int
+radix_tree_gang_lookup_contig_slot(struct radix_tree_root *root,
+			void ***results, unsigned long first_index,
+			unsigned int max_items);
 unsigned long radix_tree_next_hole(struct radix_tree_root *root,
 				unsigned long index, unsigned long max_scan);
 unsigned long radix_tree_prev_hole(struct radix_tree_root *root,
@@ -12,9 +12,11 @@
 #define _LINUX_SYSCALLS_H
 
 struct epoll_event;
+struct epoll_ctl_cmd;
 struct iattr;
 struct inode;
 struct iocb;
+struct aio_sq_ring;
 struct io_event;
 struct iovec;
 struct itimerspec;
@@ -22,6 +24,7 @@ struct itimerval;
 struct kexec_segment;
 struct linux_dirent;
 struct linux_dirent64;
+struct linux_dirent_stat;
 struct list_head;
 struct mmap_arg_struct;
 struct msgbuf;
@@ -511,6 +514,9 @@ asmlinkage long sys_io_submit(aio_context_t, long,
 				struct iocb __user * __user *);
 asmlinkage long sys_io_cancel(aio_context_t ctx_id, struct iocb __user *iocb,
 			      struct io_event __user *result);
+asmlinkage long sys_io_sq_setup(aio_context_t ctx_id,
+				struct aio_sq_ring __user *ring, unsigned nr);
+asmlinkage long sys_io_sq_enter(aio_context_t ctx_id);
 asmlinkage long sys_sendfile(int out_fd, int in_fd,
 			     off_t __user *offset, size_t count);
 asmlinkage long sys_sendfile64(int out_fd, int in_fd,
@@ -595,6 +601,9 @@ asmlinkage long sys_getdents(unsigned int fd,
 asmlinkage long sys_getdents64(unsigned int fd,
 				struct linux_dirent64 __user *dirent,
 				unsigned int count);
+asmlinkage long sys_getdents_stat(unsigned int fd,
+				struct linux_dirent_stat __user *dirent,
+				unsigned int count, unsigned int flags);
 
 asmlinkage long sys_setsockopt(int fd, int level, int optname,
 				char __user *optval, int optlen);
@@ -630,6 +639,8 @@ asmlinkage long sys_epoll_create(int size);
 asmlinkage long sys_epoll_create1(int flags);
 asmlinkage long sys_epoll_ctl(int epfd, int op, int fd,
 				struct epoll_event __user *event);
+asmlinkage long sys_epoll_ctl_batch(int epfd, int flags, int ncmds,
+				struct epoll_ctl_cmd __user *cmds);
 asmlinkage long sys_epoll_wait(int epfd, struct epoll_event __user *events,
 				int maxevents, int timeout);
 asmlinkage long sys_epoll_pwait(int epfd, struct epoll_event __user *events,
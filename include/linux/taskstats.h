@@ -33,7 +33,7 @@
  */
 
 
-#define TASKSTATS_VERSION	8
+#define TASKSTATS_VERSION	9
 #define TS_COMM_LEN		32	/* should be >= TASK_COMM_LEN
 					 * in linux/sched.h */
 
@@ -163,6 +163,13 @@ struct taskstats {
 	/* Delay waiting for memory reclaim */
 	__u64	freepages_count;
 	__u64	freepages_delay_total;
+
+	/* Version 8 ends here */
+
+	/* Current memory usage and thread count, for process monitors */
+	__u64	rss;			/* resident set size in KB */
+	__u64	vm;			/* virtual memory size in KB */
+	__u64	nr_threads;		/* threads in the thread group */
 };
 
 
@@ -63,6 +63,7 @@ cond_syscall(compat_sys_get_robust_list);
 cond_syscall(sys_epoll_create);
 cond_syscall(sys_epoll_create1);
 cond_syscall(sys_epoll_ctl);
+cond_syscall(sys_epoll_ctl_batch);
 cond_syscall(sys_epoll_wait);
 cond_syscall(sys_epoll_pwait);
 cond_syscall(compat_sys_epoll_pwait);
@@ -134,6 +135,8 @@ cond_syscall(sys_flock);
 cond_syscall(sys_io_setup);
 cond_syscall(sys_io_destroy);
 cond_syscall(sys_io_submit);
+cond_syscall(sys_io_sq_setup);
+cond_syscall(sys_io_sq_enter);
 cond_syscall(sys_io_cancel);
 cond_syscall(sys_io_getevents);
 cond_syscall(sys_syslog);
@@ -27,6 +27,8 @@
 #include <linux/cgroup.h>
 #include <linux/fs.h>
 #include <linux/file.h>
+#include <linux/pid_namespace.h>
+#include <linux/ptrace.h>
 #include <net/genetlink.h>
 #include <asm/atomic.h>
 
@@ -570,6 +572,79 @@ static int taskstats_user_cmd(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 }
 
+/*
+ * Dump requests return one TASKSTATS_TYPE_AGGR_PID record per task in the
+ * caller's pid namespace, in increasing pid order, so that monitors can
+ * poll every task with a single recvmsg() loop instead of one request (or
+ * several /proc files) per task.  With TASKSTATS_CMD_ATTR_TGID only the
+ * threads of that process are dumped.  Tasks the caller could not inspect
+ * through /proc (ptrace_may_access() in PTRACE_MODE_READ) are left out, so
+ * the dump reveals no more than /proc/<pid>/io and friends would.
+ * cb->args[0] is the pid to resume at.
+ */
+static int taskstats_user_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct pid_namespace *ns = task_active_pid_ns(current);
+	struct nlattr *attrs[TASKSTATS_CMD_ATTR_MAX + 1];
+	struct task_struct *tsk;
+	struct taskstats *stats;
+	struct pid *pid;
+	pid_t nr = cb->args[0];
+	pid_t tgid = 0;
+	void *reply;
+	int rc;
+
+	rc = nlmsg_parse(cb->nlh, GENL_HDRLEN + family.hdrsize, attrs,
+			 TASKSTATS_CMD_ATTR_MAX, taskstats_cmd_get_policy);
+	if (rc < 0)
+		return rc;
+	if (attrs[TASKSTATS_CMD_ATTR_TGID])
+		tgid = nla_get_u32(attrs[TASKSTATS_CMD_ATTR_TGID]);
+
+	for (;; nr++) {
+		rcu_read_lock();
+		pid = find_ge_pid(nr, ns);
+		if (!pid) {
+			rcu_read_unlock();
+			break;
+		}
+		nr = pid_nr_ns(pid, ns);
+		tsk = pid_task(pid, PIDTYPE_PID);
+		if (tsk && (!tgid || task_tgid_nr_ns(tsk, ns) == tgid))
+			get_task_struct(tsk);
+		else
+			tsk = NULL;
+		rcu_read_unlock();
+		if (!tsk)
+			continue;
+		if (!ptrace_may_access(tsk, PTRACE_MODE_READ)) {
+			put_task_struct(tsk);
+			continue;
+		}
+
+		reply = genlmsg_put(skb, NETLINK_CB(cb->skb).pid,
+				    cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+				    TASKSTATS_CMD_NEW);
+		if (!reply) {
+			put_task_struct(tsk);
+			break;
+		}
+		stats = mk_reply(skb, TASKSTATS_TYPE_PID, nr);
+		if (!stats) {
+			/* out of room, resume at this task next time */
+			genlmsg_cancel(skb, reply);
+			put_task_struct(tsk);
+			break;
+		}
+		fill_stats(tsk, stats);
+		put_task_struct(tsk);
+		genlmsg_end(skb, reply);
+	}
+
+	cb->args[0] = nr;
+	return skb->len;
+}
+
 static struct taskstats *taskstats_tgid_alloc(struct task_struct *tsk)
 {
 	struct signal_struct *sig = tsk->signal;
@@ -656,6 +731,7 @@ err:
 static struct genl_ops taskstats_ops = {
 	.cmd		= TASKSTATS_CMD_GET,
 	.doit		= taskstats_user_cmd,
+	.dumpit		= taskstats_user_dump,
 	.policy		= taskstats_cmd_get_policy,
 };
 
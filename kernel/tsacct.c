@@ -69,6 +69,7 @@ void bacct_add_tsk(struct taskstats *stats, struct task_struct *tsk)
 	stats->ac_stimescaled = cputime_to_usecs(tsk->stimescaled);
 	stats->ac_minflt = tsk->min_flt;
 	stats->ac_majflt = tsk->maj_flt;
+	stats->nr_threads = pid_alive(tsk) ? get_nr_threads(tsk) : 0;
 
 	strncpy(stats->ac_comm, tsk->comm, sizeof(stats->ac_comm));
 }
@@ -93,6 +94,8 @@ void xacct_add_tsk(struct taskstats *stats, struct task_struct *p)
 		/* adjust to KB unit */
 		stats->hiwater_rss   = get_mm_hiwater_rss(mm) * PAGE_SIZE / KB;
 		stats->hiwater_vm    = get_mm_hiwater_vm(mm)  * PAGE_SIZE / KB;
+		stats->rss	     = get_mm_rss(mm) * PAGE_SIZE / KB;
+		stats->vm	     = mm->total_vm * PAGE_SIZE / KB;
 		mmput(mm);
 	}
 	stats->read_char	= p->ioac.rchar;
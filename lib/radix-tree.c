@@ -999,6 +999,90 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 }
 EXPORT_SYMBOL(radix_tree_gang_lookup_slot);
 
+/*
+ * Return the bottom level node which holds the slot for @index, or NULL
+ * if there is none.
+ */
+static struct radix_tree_node *
+__lookup_leaf(struct radix_tree_node *node, unsigned long index)
+{
+	unsigned int height, shift;
+
+	height = node->height;
+	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+
+	while (height > 1) {
+		node = rcu_dereference_raw(node->slots[(index >> shift) &
+						       RADIX_TREE_MAP_MASK]);
+		if (node == NULL)
+			return NULL;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+	return node;
+}
+
+/**
+ *	radix_tree_gang_lookup_contig_slot - contiguous slot lookup
+ *	@root:		radix tree root
+ *	@results:	where the results of the lookup are placed
+ *	@first_index:	start the lookup from this key
+ *	@max_items:	place up to this many items at *results
+ *
+ *	Like radix_tree_gang_lookup_slot, but the scan stops at the first
+ *	index without an item, so *@results[i] is the slot for index
+ *	@first_index + i.  Walks the bottom level nodes slot by slot rather
+ *	than redescending the tree for every item.
+ *
+ *	Same RCU and locking rules as radix_tree_gang_lookup_slot.  An item
+ *	deleted after it was found leaves a NULL slot in *@results, which the
+ *	caller should treat as the end of the run.
+ */
+unsigned int
+radix_tree_gang_lookup_contig_slot(struct radix_tree_root *root,
+			void ***results, unsigned long first_index,
+			unsigned int max_items)
+{
+	unsigned long max_index;
+	struct radix_tree_node *node, *leaf;
+	unsigned long index = first_index;
+	unsigned int ret = 0;
+
+	node = rcu_dereference_raw(root->rnode);
+	if (!node || !max_items)
+		return 0;
+
+	if (!radix_tree_is_indirect_ptr(node)) {
+		if (first_index > 0)
+			return 0;
+		results[0] = (void **)&root->rnode;
+		return 1;
+	}
+	node = indirect_to_ptr(node);
+
+	max_index = radix_tree_maxindex(node->height);
+
+	while (index <= max_index) {
+		unsigned long i;
+
+		leaf = __lookup_leaf(node, index);
+		if (leaf == NULL)
+			break;
+		for (i = index & RADIX_TREE_MAP_MASK;
+		     i < RADIX_TREE_MAP_SIZE; i++) {
+			if (leaf->slots[i] == NULL)
+				return ret;
+			results[ret++] = (void **)&leaf->slots[i];
+			index++;
+			if (ret == max_items || index == 0)
+				return ret;	/* full, or 32-bit wraparound */
+		}
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(radix_tree_gang_lookup_contig_slot);
+
 /*
  * FIXME: the two tag_get()s here should use find_next_bit() instead of
  * open-coding the search.
@@ -64,7 +64,9 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
 	unsigned long nr_dirty, nr_io, nr_more_io, nr_wb;
+	struct wb_class_stat stat[NR_WB_CLASSES];
 	struct inode *inode;
+	int i;
 
 	nr_wb = nr_dirty = nr_io = nr_more_io = 0;
 	spin_lock(&inode_wb_list_lock);
@@ -79,6 +81,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 	global_dirty_limits(&background_thresh, &dirty_thresh);
 	bdi_thresh = bdi_dirty_limit(bdi, dirty_thresh);
 
+	spin_lock_bh(&bdi->wb_lock);
+	memcpy(stat, bdi->wb_class_stat, sizeof(stat));
+	spin_unlock_bh(&bdi->wb_lock);
+
 #define K(x) ((x) << (PAGE_SHIFT - 10))
 	seq_printf(m,
 		   "BdiWriteback:     %8lu kB\n"
@@ -86,6 +92,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtyThresh:   %8lu kB\n"
 		   "DirtyThresh:      %8lu kB\n"
 		   "BackgroundThresh: %8lu kB\n"
+		   "BdiDirtied:       %8lu kB\n"
+		   "BdiWritten:       %8lu kB\n"
+		   "BdiWriteBandwidth: %8lu kBps\n"
+		   "BdiDirtyRatelimit: %8lu kBps\n"
 		   "b_dirty:          %8lu\n"
 		   "b_io:             %8lu\n"
 		   "b_more_io:        %8lu\n"
@@ -94,10 +104,31 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
 		   K(bdi_thresh), K(dirty_thresh),
-		   K(background_thresh), nr_dirty, nr_io, nr_more_io,
+		   K(background_thresh),
+		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
+		   (unsigned long) K(bdi->write_bandwidth),
+		   (unsigned long) K(bdi->dirty_ratelimit),
+		   nr_dirty, nr_io, nr_more_io,
 		   !list_empty(&bdi->bdi_list), bdi->state);
 #undef K
 
+	/* works, preemptions, average and maximum latency in ms per class */
+	for (i = 0; i < NR_WB_CLASSES; i++) {
+		static const char *names[NR_WB_CLASSES] = {
+			[WB_CLASS_SYNC]		= "sync",
+			[WB_CLASS_ASYNC]	= "async",
+			[WB_CLASS_BACKGROUND]	= "background",
+		};
+		unsigned long avg = stat[i].nr_works ?
+			stat[i].total_latency / stat[i].nr_works : 0;
+
+		seq_printf(m, "class_%-10s %8lu %8lu %8u %8u\n", names[i],
+			   stat[i].nr_works, stat[i].nr_preempted,
+			   jiffies_to_msecs(avg),
+			   jiffies_to_msecs(stat[i].max_latency));
+	}
+
 	return 0;
 }
 
@@ -377,7 +408,7 @@ static int bdi_forker_thread(void *ptr)
 		 * Temporary measure, we want to make sure we don't see
 		 * dirty data on the default backing_dev_info
 		 */
-		if (wb_has_dirty_io(me) || !list_empty(&me->bdi->work_list)) {
+		if (wb_has_dirty_io(me) || bdi_has_work(me->bdi)) {
 			del_timer(&me->wakeup_timer);
 			wb_do_writeback(me, 0);
 		}
@@ -395,7 +426,7 @@ static int bdi_forker_thread(void *ptr)
 			WARN(!test_bit(BDI_registered, &bdi->state),
 			     "bdi %p/%s is not registered!\n", bdi, bdi->name);
 
-			have_dirty_io = !list_empty(&bdi->work_list) ||
+			have_dirty_io = bdi_has_work(bdi) ||
 					wb_has_dirty_io(&bdi->wb);
 
 			/*
@@ -435,7 +466,7 @@ static int bdi_forker_thread(void *ptr)
 		spin_unlock_bh(&bdi_lock);
 
 		/* Keep working if default bdi still has things to do */
-		if (!list_empty(&me->bdi->work_list))
+		if (bdi_has_work(me->bdi))
 			__set_current_state(TASK_RUNNING);
 
 		switch (action) {
@@ -631,6 +662,11 @@ static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
 	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)bdi);
 }
 
+/*
+ * Initial write bandwidth: 100 MB/s
+ */
+#define INIT_BW		(100 << (20 - PAGE_SHIFT))
+
 int bdi_init(struct backing_dev_info *bdi)
 {
 	int i, err;
@@ -642,7 +678,9 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->max_prop_frac = PROP_FRAC_BASE;
 	spin_lock_init(&bdi->wb_lock);
 	INIT_LIST_HEAD(&bdi->bdi_list);
-	INIT_LIST_HEAD(&bdi->work_list);
+	for (i = 0; i < NR_WB_CLASSES; i++)
+		INIT_LIST_HEAD(&bdi->work_list[i]);
+	memset(bdi->wb_class_stat, 0, sizeof(bdi->wb_class_stat));
 
 	bdi_wb_init(&bdi->wb, bdi);
 
@@ -653,6 +691,15 @@ int bdi_init(struct backing_dev_info *bdi)
 	}
 
 	bdi->dirty_exceeded = 0;
+
+	bdi->bw_time_stamp = jiffies;
+	bdi->written_stamp = 0;
+
+	bdi->balanced_dirty_ratelimit = INIT_BW;
+	bdi->dirty_ratelimit = INIT_BW;
+	bdi->write_bandwidth = INIT_BW;
+	bdi->avg_write_bandwidth = INIT_BW;
+
 	err = prop_local_init_percpu(&bdi->completions);
 
 	if (err) {
@@ -166,6 +166,42 @@ void delete_from_page_cache(struct page *page)
 }
 EXPORT_SYMBOL(delete_from_page_cache);
 
+/**
+ * delete_from_page_cache_batch - delete several pages from the page cache
+ * @mapping: the address_space all the pages belong to
+ * @pvec: the pages
+ *
+ * Like delete_from_page_cache() on each page of @pvec, which must all be
+ * locked and verified to be in @mapping, but with a single tree_lock
+ * hold for the whole batch.  The page cache references are dropped; the
+ * caller's references and page locks are not.
+ */
+void delete_from_page_cache_batch(struct address_space *mapping,
+				  struct pagevec *pvec)
+{
+	void (*freepage)(struct page *) = mapping->a_ops->freepage;
+	int i;
+
+	if (!pagevec_count(pvec))
+		return;
+
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		BUG_ON(!PageLocked(pvec->pages[i]));
+		__delete_from_page_cache(pvec->pages[i]);
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+
+		mem_cgroup_uncharge_cache_page(page);
+		if (freepage)
+			freepage(page);
+		page_cache_release(page);
+	}
+}
+
 static int sleep_on_page(void *word)
 {
 	io_schedule();
@@ -512,6 +548,82 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_lru_batch - add several new pages to the page cache
+ * @pvec: the pages, unlocked and not yet visible to anybody else, with
+ *	  ->index set to their offsets in @mapping
+ * @mapping: the address_space to add them to
+ * @gfp_mask: page allocation mode
+ *
+ * Like add_to_page_cache_lru() on each page, but the radix tree is
+ * preloaded once and all pages are inserted under a single tree_lock
+ * hold, which is what readahead wants for its runs of adjacent pages.
+ * Radix tree nodes beyond the preload are allocated atomically.
+ *
+ * Pages that were added are returned locked, with ->mapping set and an
+ * extra reference held by the page cache.  Pages that could not be added
+ * (already present, or out of memory) are left unlocked with ->mapping
+ * NULL.  Returns the number of pages added.
+ */
+int add_to_page_cache_lru_batch(struct pagevec *pvec,
+				struct address_space *mapping, gfp_t gfp_mask)
+{
+	int i, added = 0;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+
+		/* see add_to_page_cache_lru() */
+		if (mapping_cap_swap_backed(mapping))
+			SetPageSwapBacked(page);
+		/* PageLocked marks the pages still to be inserted below */
+		if (!mem_cgroup_cache_charge(page, current->mm,
+					gfp_mask & GFP_RECLAIM_MASK))
+			__set_page_locked(page);
+	}
+
+	if (radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM))
+		goto out;
+
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+
+		if (!PageLocked(page))
+			continue;
+		if (radix_tree_insert(&mapping->page_tree, page->index, page))
+			continue;
+		page_cache_get(page);
+		page->mapping = mapping;
+		mapping->nrpages++;
+		__inc_zone_page_state(page, NR_FILE_PAGES);
+		if (PageSwapBacked(page))
+			__inc_zone_page_state(page, NR_SHMEM);
+		added++;
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+	radix_tree_preload_end();
+
+out:
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+
+		if (!PageLocked(page))
+			continue;
+		if (page->mapping) {
+			if (page_is_file_cache(page))
+				lru_cache_add_file(page);
+			else
+				lru_cache_add_anon(page);
+		} else {
+			mem_cgroup_uncharge_cache_page(page);
+			__clear_page_locked(page);
+		}
+	}
+	return added;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -864,7 +976,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+	nr_found = radix_tree_gang_lookup_contig_slot(&mapping->page_tree,
 				(void ***)pages, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
@@ -872,7 +984,7 @@ restart:
 repeat:
 		page = radix_tree_deref_slot((void **)pages[i]);
 		if (unlikely(!page))
-			continue;
+			break;
 
 		/*
 		 * This can only trigger when the entry at index 0 moves out
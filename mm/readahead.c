@@ -110,8 +110,9 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
 	struct blk_plug plug;
+	struct pagevec pvec;
 	unsigned page_idx;
-	int ret;
+	int ret, i;
 
 	blk_start_plug(&plug);
 
@@ -122,14 +123,24 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
-	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = list_to_page(pages);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
+	pagevec_init(&pvec, 0);
+	for (page_idx = 0; page_idx < nr_pages; ) {
+		do {
+			struct page *page = list_to_page(pages);
+			list_del(&page->lru);
+			page_idx++;
+			if (!pagevec_add(&pvec, page))
+				break;
+		} while (page_idx < nr_pages);
+
+		add_to_page_cache_lru_batch(&pvec, mapping, GFP_KERNEL);
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+			if (page->mapping == mapping)
+				mapping->a_ops->readpage(filp, page);
+			page_cache_release(page);
 		}
-		page_cache_release(page);
+		pagevec_reinit(&pvec);
 	}
 	ret = 0;
 
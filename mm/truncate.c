@@ -95,7 +95,7 @@ EXPORT_SYMBOL(cancel_dirty_page);
  * c) when tmpfs swizzles a page between a tmpfs inode and swapper_space.
  */
 static int
-truncate_complete_page(struct address_space *mapping, struct page *page)
+truncate_cleanup_page(struct address_space *mapping, struct page *page)
 {
 	if (page->mapping != mapping)
 		return -EIO;
@@ -107,10 +107,34 @@ truncate_complete_page(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	ClearPageMappedToDisk(page);
-	delete_from_page_cache(page);
 	return 0;
 }
 
+static int
+truncate_complete_page(struct address_space *mapping, struct page *page)
+{
+	int ret = truncate_cleanup_page(mapping, page);
+
+	if (!ret)
+		delete_from_page_cache(page);
+	return ret;
+}
+
+/*
+ * Remove the locked pages gathered by truncate_inode_pages_range() from the
+ * page cache in one go, and unlock them.
+ */
+static void truncate_locked_pages(struct address_space *mapping,
+				  struct pagevec *locked)
+{
+	int i;
+
+	delete_from_page_cache_batch(mapping, locked);
+	for (i = 0; i < pagevec_count(locked); i++)
+		unlock_page(locked->pages[i]);
+	pagevec_reinit(locked);
+}
+
 /*
  * This is for invalidate_mapping_pages().  That function can be called at
  * any time, and is not supposed to throw away dirty pages.  But pages can
@@ -211,6 +235,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t end;
 	const unsigned partial = lstart & (PAGE_CACHE_SIZE - 1);
 	struct pagevec pvec;
+	struct pagevec locked;
 	pgoff_t next;
 	int i;
 
@@ -221,6 +246,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	end = (lend >> PAGE_CACHE_SHIFT);
 
 	pagevec_init(&pvec, 0);
+	pagevec_init(&locked, 0);
 	next = start;
 	while (next <= end &&
 	       pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
@@ -243,9 +269,28 @@ void truncate_inode_pages_range(struct address_space *mapping,
 				unlock_page(page);
 				continue;
 			}
-			truncate_inode_page(mapping, page);
-			unlock_page(page);
+			/*
+			 * Pages with fs-private data go one at a time, so
+			 * ->invalidatepage never runs with others locked.
+			 */
+			if (page_has_private(page)) {
+				truncate_locked_pages(mapping, &locked);
+				truncate_inode_page(mapping, page);
+				unlock_page(page);
+				continue;
+			}
+			if (page_mapped(page)) {
+				unmap_mapping_range(mapping,
+				    (loff_t)page_index << PAGE_CACHE_SHIFT,
+				    PAGE_CACHE_SIZE, 0);
+			}
+			if (truncate_cleanup_page(mapping, page)) {
+				unlock_page(page);
+				continue;
+			}
+			pagevec_add(&locked, page);
 		}
+		truncate_locked_pages(mapping, &locked);
 		pagevec_release(&pvec);
 		mem_cgroup_uncharge_end();
 		cond_resched();